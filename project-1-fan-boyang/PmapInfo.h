@@ -0,0 +1,26 @@
+#ifndef _PMAPINFO_H_
+#define _PMAPINFO_H_
+
+// Regions of a process's memory, low addresses first.
+#define PMAP_TEXT 0 // executable code and initialized data
+#define PMAP_DATA 1 // rest of the image: bss and writable segments
+#define PMAP_STACK 2 // guard page and user stack
+#define PMAP_HEAP 3 // grown by sbrk()
+#define PMAP_NREGION 4
+
+struct PmapRegion {
+   uint start; // first virtual address
+   uint size; // size in bytes
+   uint resident; // pages present in the page table
+};
+
+struct PmapInfo {
+   char name[16]; // name of process
+   int pid; // process id
+   uint sz; // size in bytes
+   struct PmapRegion region[PMAP_NREGION];
+   uint ptpages; // page directory and page table pages
+   uint kstack; // kernel stack in bytes
+ };
+
+#endif //_PMAPINFO_H_
@@ -10,6 +10,7 @@ struct sleeplock;
 struct stat;
 struct superblock;
 struct ProcessInfo;
+struct PmapInfo;
 
 // bio.c
 void            binit(void);
@@ -122,6 +123,7 @@ int             wait(void);
 void            wakeup(void*);
 void            yield(void);
 int             getprocs(struct ProcessInfo*);
+int             getpmap(int, struct PmapInfo*);
 
 // swtch.S
 void            swtch(struct context**, struct context*);
@@ -187,6 +189,8 @@ void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
+uint            uvmresident(pde_t*, uint, uint);
+uint            uvmptpages(pde_t*);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
@@ -1,6 +1,12 @@
 // Physical memory allocator, intended to allocate
 // memory for user processes, kernel stacks, page table pages,
 // and pipe buffers. Allocates 4096-byte pages.
+//
+// Each CPU keeps a small cache of free pages so that kalloc()
+// and kfree() normally touch only that CPU's cache lock.
+// Pages move between a cache and the global kmem.freelist
+// KBATCH at a time; a CPU that finds both its cache and the
+// global list empty steals half of another CPU's cache.
 
 #include "types.h"
 #include "defs.h"
@@ -9,6 +15,9 @@
 #include "mmu.h"
 #include "spinlock.h"
 
+#define KBATCH     32          // pages moved to or from kmem.freelist at once
+#define KCACHEMAX  (2*KBATCH)  // a CPU cache drains above this many pages
+
 void freerange(void *vstart, void *vend);
 extern char end[]; // first address after kernel loaded from ELF file
                    // defined by the kernel linker script in kernel.ld
@@ -17,10 +26,19 @@ struct run {
   struct run *next;
 };
 
+// Free pages cached by one CPU. Only the owning CPU adds
+// pages; other CPUs take the lock only to steal.
+struct kcache {
+  struct spinlock lock;
+  struct run *freelist;
+  int nfree;
+};
+
 struct {
   struct spinlock lock;
   int use_lock;
   struct run *freelist;
+  struct kcache cache[NCPU];
 } kmem;
 
 // Initialization happens in two phases.
@@ -28,10 +46,16 @@ struct {
 // the pages mapped by entrypgdir on free list.
 // 2. main() calls kinit2() with the rest of the physical pages
 // after installing a full page table that maps them on all cores.
+// Until kinit2() is done only the global list is used, since
+// mycpu() does not work before lapicinit().
 void
 kinit1(void *vstart, void *vend)
 {
+  int i;
+
   initlock(&kmem.lock, "kmem");
+  for(i = 0; i < NCPU; i++)
+    initlock(&kmem.cache[i].lock, "kcache");
   kmem.use_lock = 0;
   freerange(vstart, vend);
 }
@@ -51,6 +75,72 @@ freerange(void *vstart, void *vend)
   for(; p + PGSIZE <= (char*)vend; p += PGSIZE)
     kfree(p);
 }
+
+// Move up to n pages from the list *from to the list *to.
+// Returns the number of pages moved.
+static int
+kmove(struct run **to, struct run **from, int n)
+{
+  struct run *r;
+  int i;
+
+  for(i = 0; i < n && (r = *from) != 0; i++){
+    *from = r->next;
+    r->next = *to;
+    *to = r;
+  }
+  return i;
+}
+
+// Take half of some other CPU's cache onto *list.
+// Called holding no kmem locks.
+static int
+ksteal(struct kcache *kc, struct run **list)
+{
+  struct kcache *victim;
+  int n;
+
+  for(victim = kmem.cache; victim < &kmem.cache[NCPU]; victim++){
+    if(victim == kc || victim->nfree == 0)
+      continue;
+    acquire(&victim->lock);
+    n = kmove(list, &victim->freelist, (victim->nfree + 1) / 2);
+    victim->nfree -= n;
+    release(&victim->lock);
+    if(n > 0)
+      return n;
+  }
+  return 0;
+}
+
+// Refill the empty cache kc with a batch of pages, from the
+// global list if possible and from another CPU otherwise.
+// Returns one page for the caller, or 0 if memory is exhausted.
+// Called with interrupts off and holding no kmem locks.
+static struct run*
+krefill(struct kcache *kc)
+{
+  struct run *r, *batch;
+  int n;
+
+  batch = 0;
+  acquire(&kmem.lock);
+  n = kmove(&batch, &kmem.freelist, KBATCH);
+  release(&kmem.lock);
+  if(n == 0 && (n = ksteal(kc, &batch)) == 0)
+    return 0;
+
+  r = batch;
+  batch = r->next;
+  if(--n > 0){
+    acquire(&kc->lock);
+    kmove(&kc->freelist, &batch, n);
+    kc->nfree += n;
+    release(&kc->lock);
+  }
+  return r;
+}
+
 //PAGEBREAK: 21
 // Free the page of physical memory pointed at by v,
 // which normally should have been returned by a
@@ -59,7 +149,9 @@ freerange(void *vstart, void *vend)
 void
 kfree(char *v)
 {
-  struct run *r;
+  struct kcache *kc;
+  struct run *r, *batch;
+  int n;
 
   if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
     panic("kfree");
@@ -67,13 +159,32 @@ kfree(char *v)
   // Fill with junk to catch dangling refs.
   memset(v, 1, PGSIZE);
 
-  if(kmem.use_lock)
-    acquire(&kmem.lock);
   r = (struct run*)v;
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  if(kmem.use_lock)
+  if(!kmem.use_lock){
+    r->next = kmem.freelist;
+    kmem.freelist = r;
+    return;
+  }
+
+  pushcli();
+  kc = &kmem.cache[cpuid()];
+  acquire(&kc->lock);
+  r->next = kc->freelist;
+  kc->freelist = r;
+  batch = 0;
+  n = 0;
+  if(++kc->nfree > KCACHEMAX){
+    n = kmove(&batch, &kc->freelist, KBATCH);
+    kc->nfree -= n;
+  }
+  release(&kc->lock);
+
+  if(n > 0){
+    acquire(&kmem.lock);
+    kmove(&kmem.freelist, &batch, n);
     release(&kmem.lock);
+  }
+  popcli();
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -82,15 +193,27 @@ kfree(char *v)
 char*
 kalloc(void)
 {
+  struct kcache *kc;
   struct run *r;
 
-  if(kmem.use_lock)
-    acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  if(kmem.use_lock)
-    release(&kmem.lock);
+  if(!kmem.use_lock){
+    r = kmem.freelist;
+    if(r)
+      kmem.freelist = r->next;
+    return (char*)r;
+  }
+
+  pushcli();
+  kc = &kmem.cache[cpuid()];
+  acquire(&kc->lock);
+  r = kc->freelist;
+  if(r){
+    kc->freelist = r->next;
+    kc->nfree--;
+  }
+  release(&kc->lock);
+  if(r == 0)
+    r = krefill(kc);
+  popcli();
   return (char*)r;
 }
-
@@ -0,0 +1,82 @@
+#include "types.h"
+#include "user.h"
+#include "ProcessInfo.h"
+#include "PmapInfo.h"
+
+#define MAX_PROC 64 // maximum number of processes
+#define PGSIZE 4096
+
+static char *regions[] = {
+    [PMAP_TEXT] "text ",
+    [PMAP_DATA] "data ",
+    [PMAP_STACK] "stack",
+    [PMAP_HEAP] "heap "};
+
+// Resident pages of all regions, plus the pages the kernel
+// spends on page tables and the kernel stack.
+int total(struct PmapInfo *m)
+{
+    int i, n = 0;
+
+    for (i = 0; i < PMAP_NREGION; i++)
+        n += m->region[i].resident;
+    return n + m->ptpages + m->kstack / PGSIZE;
+}
+
+// One line per process, to find the ones using the most memory.
+void summary(void)
+{
+    struct ProcessInfo *p = malloc(MAX_PROC * sizeof(struct ProcessInfo));
+    struct PmapInfo m;
+    int count = ps(p);
+    int i;
+
+    if (count <= 0)
+    {
+        printf(2, "pmap: ps failed\n");
+        exit();
+    }
+    printf(1, "pid  name  sz  resident  pagetables  total(pages)\n");
+    for (i = 0; i < count; i++)
+    {
+        if (pmap(p[i].pid, &m) < 0)
+            continue;
+        printf(1, "%d  %s  %d  %d  %d  %d\n", m.pid, m.name, m.sz,
+               total(&m) - m.ptpages - m.kstack / PGSIZE, m.ptpages, total(&m));
+    }
+    free(p);
+}
+
+// Every region of process pid.
+void detail(int pid)
+{
+    struct PmapInfo m;
+    int i;
+
+    if (pmap(pid, &m) < 0)
+    {
+        printf(2, "pmap: no process %d\n", pid);
+        return;
+    }
+    printf(1, "%d: %s\n", m.pid, m.name);
+    printf(1, "region  start  size(KB)  resident(pages)\n");
+    for (i = 0; i < PMAP_NREGION; i++)
+    {
+        printf(1, "%s  0x%x  %d  %d\n", regions[i], m.region[i].start,
+               m.region[i].size / 1024, m.region[i].resident);
+    }
+    printf(1, "page tables  %d pages\n", m.ptpages);
+    printf(1, "kernel stack  %d pages\n", m.kstack / PGSIZE);
+    printf(1, "total  %d pages\n", total(&m));
+}
+
+int main(int argc, char *argv[])
+{
+    int i;
+
+    if (argc < 2)
+        summary();
+    for (i = 1; i < argc; i++)
+        detail(atoi(argv[i]));
+    exit();
+}
@@ -7,6 +7,7 @@
 #include "proc.h"
 #include "spinlock.h"
 #include "ProcessInfo.h"
+#include "PmapInfo.h"
 
 struct
 {
@@ -133,6 +134,9 @@ void userinit(void)
     panic("userinit: out of memory?");
   inituvm(p->pgdir, _binary_initcode_start, (int)_binary_initcode_size);
   p->sz = PGSIZE;
+  p->textsz = PGSIZE;
+  p->datasz = PGSIZE;
+  p->heapbase = PGSIZE;
   memset(p->tf, 0, sizeof(*p->tf));
   p->tf->cs = (SEG_UCODE << 3) | DPL_USER;
   p->tf->ds = (SEG_UDATA << 3) | DPL_USER;
@@ -203,6 +207,9 @@ int fork(void)
     return -1;
   }
   np->sz = curproc->sz;
+  np->textsz = curproc->textsz;
+  np->datasz = curproc->datasz;
+  np->heapbase = curproc->heapbase;
   np->parent = curproc;
   *np->tf = *curproc->tf;
 
@@ -568,4 +575,50 @@ int getprocs(struct ProcessInfo *processInfoTable)
     count++;
   }
   return count;
-}
\ No newline at end of file
+}
+
+// Fill in pmapInfo for process pid: the bounds of each region
+// and how many of its pages are present, and the memory the
+// kernel spends on the process. Returns -1 if there is no such
+// process.
+int getpmap(int pid, struct PmapInfo *pmapInfo)
+{
+  struct proc *p;
+  uint bound[PMAP_NREGION + 1];
+  int i;
+
+  acquire(&ptable.lock);
+  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  {
+    if (p->pid == pid && p->state != UNUSED && p->state != EMBRYO && p->pgdir)
+      break;
+  }
+  if (p == &ptable.proc[NPROC])
+  {
+    release(&ptable.lock);
+    return -1;
+  }
+  strncpy(pmapInfo->name, p->name, 16);
+  pmapInfo->pid = p->pid;
+  pmapInfo->sz = p->sz;
+  bound[PMAP_TEXT] = 0;
+  bound[PMAP_DATA] = p->textsz;
+  bound[PMAP_STACK] = p->datasz;
+  bound[PMAP_HEAP] = p->heapbase;
+  bound[PMAP_NREGION] = p->sz;
+  // sbrk() may have shrunk the process below heapbase, or even
+  // datasz; the regions past sz are then empty.
+  for (i = 0; i < PMAP_NREGION; i++)
+    if (bound[i] > p->sz)
+      bound[i] = p->sz;
+  for (i = 0; i < PMAP_NREGION; i++)
+  {
+    pmapInfo->region[i].start = bound[i];
+    pmapInfo->region[i].size = bound[i + 1] - bound[i];
+    pmapInfo->region[i].resident = uvmresident(p->pgdir, bound[i], bound[i + 1]);
+  }
+  pmapInfo->ptpages = uvmptpages(p->pgdir);
+  pmapInfo->kstack = KSTACKSIZE;
+  release(&ptable.lock);
+  return 0;
+}
@@ -60,6 +60,9 @@ struct proc
   struct file *ofile[NOFILE]; // Open files
   struct inode *cwd;          // Current directory
   char name[16];              // Process name (debugging)
+  uint textsz;                // End of text, for pmap
+  uint datasz;                // End of data and bss
+  uint heapbase;              // Start of heap
 };
 
 // Process memory is laid out contiguously, low addresses first:
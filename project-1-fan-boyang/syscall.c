@@ -87,6 +87,7 @@ extern int sys_fork(void);
 extern int sys_fstat(void);
 extern int sys_getpid(void);
 extern int sys_ps(void);
+extern int sys_pmap(void);
 extern int sys_kill(void);
 extern int sys_link(void);
 extern int sys_mkdir(void);
@@ -114,6 +115,7 @@ static int (*syscalls[])(void) = {
     [SYS_dup] sys_dup,
     [SYS_getpid] sys_getpid,
     [SYS_ps] sys_ps,
+    [SYS_pmap] sys_pmap,
     [SYS_sbrk] sys_sbrk,
     [SYS_sleep] sys_sleep,
     [SYS_uptime] sys_uptime,
@@ -7,6 +7,7 @@
 #include "mmu.h"
 #include "proc.h"
 #include "ProcessInfo.h"
+#include "PmapInfo.h"
 
 int
 sys_fork(void)
@@ -54,6 +55,16 @@ sys_ps(void)
   return count;
 }
 
+int
+sys_pmap(void)
+{
+  int pid;
+  struct PmapInfo *pmap_info;
+  if(argint(0, &pid) < 0 || argptr(1, (char **)&pmap_info, sizeof(struct PmapInfo)) < 0)
+    return -1;
+  return getpmap(pid, pmap_info);
+}
+
 int
 sys_sbrk(void)
 {
@@ -1,6 +1,7 @@
 struct stat;
 struct rtcdate;
 struct ProcessInfo;
+struct PmapInfo;
 // system calls
 int fork(void);
 int exit(void) __attribute__((noreturn));
@@ -21,6 +22,7 @@ int chdir(const char*);
 int dup(int);
 int getpid(void);
 int ps(struct ProcessInfo*);
+int pmap(int, struct PmapInfo*);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
@@ -344,6 +344,39 @@ bad:
   return 0;
 }
 
+// Count the pages of [start, end) present in pgdir.
+uint
+uvmresident(pde_t *pgdir, uint start, uint end)
+{
+  pte_t *pte;
+  uint a, n;
+
+  n = 0;
+  for(a = PGROUNDDOWN(start); a < end; a += PGSIZE){
+    if((pte = walkpgdir(pgdir, (char*)a, 0)) == 0){
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+      continue;
+    }
+    if(*pte & PTE_P)
+      n++;
+  }
+  return n;
+}
+
+// Count the pages holding pgdir itself and its page tables,
+// the kernel's mappings included.
+uint
+uvmptpages(pde_t *pgdir)
+{
+  uint i, n;
+
+  n = 1;
+  for(i = 0; i < NPDENTRIES; i++)
+    if(pgdir[i] & PTE_P)
+      n++;
+  return n;
+}
+
 //PAGEBREAK!
 // Map user virtual address to kernel address.
 char*
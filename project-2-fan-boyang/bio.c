@@ -139,6 +139,22 @@ brelse(struct buf *b)
   
   release(&bcache.lock);
 }
+
+// Count the buffers holding disk data.
+int
+bcache_count(void)
+{
+  struct buf *b;
+  int n;
+
+  acquire(&bcache.lock);
+  n = 0;
+  for(b = bcache.buf; b < bcache.buf+NBUF; b++)
+    if(b->flags & B_VALID)
+      n++;
+  release(&bcache.lock);
+  return n;
+}
 //PAGEBREAK!
 // Blank page.
 
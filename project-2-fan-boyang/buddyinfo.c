@@ -0,0 +1,40 @@
+// Print the physical page allocator's free block counts,
+// fragmentation and allocation latency for each buddy order.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "buddyinfo.h"
+
+int
+main(int argc, char *argv[])
+{
+  struct buddyinfo bi;
+  uint freepages, small;
+  int k;
+
+  if(buddyinfo(&bi) < 0){
+    printf(2, "buddyinfo failed\n");
+    exit();
+  }
+
+  freepages = bi.ncached;
+  for(k = 0; k <= MAXORDER; k++)
+    freepages += bi.nfree[k] << k;
+  printf(1, "free pages %d (%d in per-CPU caches), %d pre-zeroed\n",
+         freepages, bi.ncached, bi.nzero);
+
+  // The unusable index of order k is the share of free memory
+  // that sits in blocks too small to satisfy an order-k request.
+  printf(1, "order  free  unusable%%  allocs  fails  avgcyc  maxcyc\n");
+  small = 0;
+  for(k = 0; k <= MAXORDER; k++){
+    printf(1, "%d  %d  %d  %d  %d  %d  %d\n", k, bi.nfree[k],
+           freepages ? small * 100 / freepages : 0,
+           bi.nalloc[k], bi.nfail[k], bi.avgcycles[k], bi.maxcycles[k]);
+    small += bi.nfree[k] << k;
+    if(k == 0)
+      small += bi.ncached;
+  }
+  exit();
+}
@@ -0,0 +1,18 @@
+#ifndef _BUDDYINFO_H_
+#define _BUDDYINFO_H_
+
+#define MAXORDER 10  // largest kalloc_pages() block is 2^MAXORDER pages
+
+// Allocation latencies are in rdtsc cycles. Order 0 covers every
+// kalloc(), including the ones served from a per-CPU cache.
+struct buddyinfo {
+  uint nfree[MAXORDER+1];     // free blocks of each order
+  uint ncached;               // free pages sitting in per-CPU caches
+  uint nzero;                 // pre-zeroed pages waiting for kalloc_zeroed()
+  uint nalloc[MAXORDER+1];    // successful allocations of each order
+  uint nfail[MAXORDER+1];     // failed allocations of each order
+  uint avgcycles[MAXORDER+1]; // moving average allocation latency
+  uint maxcycles[MAXORDER+1]; // worst allocation latency
+};
+
+#endif //_BUDDYINFO_H_
@@ -0,0 +1,73 @@
+// Copy-on-write fault microbenchmark.
+// The parent dirties NPAGES pages and then forks ROUNDS
+// children twice over. In the first pass each child exits
+// straight away; in the second it writes every page, taking
+// one COW fault per page, and re-reads a small hot set of
+// pages between faults, which stays in the TLB as long as the
+// fault handler does not flush all of it. The difference
+// between the two passes is the cost of the faults.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define PGSIZE  4096
+#define NPAGES  256
+#define NHOT    32
+#define ROUNDS  50
+
+char *mem;
+
+int
+pass(int write)
+{
+  int i, j, r, pid, start;
+  volatile int sum;
+
+  start = uptime();
+  for(r = 0; r < ROUNDS; r++){
+    pid = fork();
+    if(pid < 0){
+      printf(1, "cowbench: fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      if(write){
+        sum = 0;
+        for(i = 0; i < NPAGES; i++){
+          mem[i * PGSIZE] = i;
+          for(j = 0; j < NHOT; j++)
+            sum += mem[j * PGSIZE];
+        }
+      }
+      exit();
+    }
+    wait();
+  }
+  return uptime() - start;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, base, t, nfault;
+
+  mem = sbrk(NPAGES * PGSIZE);
+  if(mem == (char*)-1){
+    printf(1, "cowbench: sbrk failed\n");
+    exit();
+  }
+  for(i = 0; i < NPAGES; i++)
+    mem[i * PGSIZE] = 1;
+
+  base = pass(0);
+  t = pass(1);
+  nfault = ROUNDS * NPAGES;
+  printf(1, "cowbench: %d faults, fork+exit %d ticks, with faults %d ticks\n",
+         nfault, base, t);
+  if(t > base)
+    printf(1, "cowbench: %d faults/sec\n", nfault * 100 / (t - base));
+  else
+    printf(1, "cowbench: too fast to measure, raise ROUNDS\n");
+  exit();
+}
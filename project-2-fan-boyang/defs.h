@@ -1,20 +1,28 @@
+struct buddyinfo;
 struct buf;
 struct context;
 struct file;
 struct inode;
+struct kmem_cache;
+struct ksminfo;
 struct pipe;
 struct proc;
+struct rmap;
 struct rtcdate;
+struct shm;
 struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct vmstat;
+struct swapinfo;
 
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+int             bcache_count(void);
 
 // console.c
 void            consoleinit(void);
@@ -40,6 +48,9 @@ int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
+void            idenywrite(struct inode*);
+void            iallowwrite(struct inode*);
+void            icacheinit(void);
 void            iinit(int dev);
 void            ilock(struct inode*);
 void            iput(struct inode*);
@@ -65,16 +76,27 @@ void            ioapicinit(void);
 
 // kalloc.c
 char*           kalloc(void);
+char*           kalloc_pages(int);
+char*           kalloc_zeroed(void);
+char*           kalloc_perm(void);
+void            kbuddyinfo(struct buddyinfo*);
 void            kfree(char*);
+void            kfree_pages(char*, int);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
+void            kzeroidle(void);
 void            inc_ref_count(uint);
-void            dec_ref_count(uint);
 uint            get_ref_count(uint);
+void            vmcount(int, int);
+void            kvmstat(struct vmstat*);
 
 // kbd.c
 void            kbdintr(void);
 
+// ksm.c
+void            ksmidle(void);
+void            ksmctl(int, struct ksminfo*);
+
 // lapic.c
 void            cmostime(struct rtcdate *r);
 int             lapicid(void);
@@ -100,6 +122,7 @@ void            picinit(void);
 
 // pipe.c
 int             pipealloc(struct file**, struct file**);
+void            pipeinit(void);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, char*, int);
 int             pipewrite(struct pipe*, char*, int);
@@ -123,6 +146,9 @@ void            userinit(void);
 int             wait(void);
 void            wakeup(void*);
 void            yield(void);
+void            ptablelock(void);
+void            ptableunlock(void);
+int             pageoutok(pde_t*, uint);
 
 // swtch.S
 void            swtch(struct context**, struct context*);
@@ -131,11 +157,62 @@ void            swtch(struct context**, struct context*);
 void            acquire(struct spinlock*);
 void            getcallerpcs(void*, uint*);
 int             holding(struct spinlock*);
+int             holdinglocks(void);
 void            initlock(struct spinlock*, char*);
 void            release(struct spinlock*);
 void            pushcli(void);
 void            popcli(void);
 
+// slab.c
+void*           kmem_cache_alloc(struct kmem_cache*);
+void            kmem_cache_free(struct kmem_cache*, void*);
+void            kmem_cache_init(struct kmem_cache*, char*, uint);
+
+// mmap.c
+struct vma*     vmaalloc(struct proc*, uint);
+struct vma*     findvma(struct proc*, uint);
+int             mmap(struct file*, uint, int, int, uint);
+int             mmapfault(struct proc*, uint);
+int             munmap(uint, uint);
+void            munmapall(struct proc*, pde_t*);
+int             shmdt(uint);
+int             madvise(uint, uint, int);
+int             readahead(struct proc*, uint);
+void            dupvmas(struct proc*, struct proc*);
+
+// pcache.c
+void            pcacheinit(void);
+char*           pcache_get(struct inode*, uint, int);
+void            pcache_read(struct inode*, char*, uint, uint);
+void            pcache_write(struct inode*, char*, uint, uint);
+void            pcache_invalidate(struct inode*);
+int             pcache_reclaim(void);
+int             pcache_count(void);
+
+// shm.c
+void            shminit(void);
+int             shmget(int, uint);
+int             shmat(int);
+int             shmrm(int);
+void            shmdup(struct shm*);
+void            shmput(struct shm*);
+
+// swap.c
+extern struct spinlock vmlock;
+void            swapinit(void);
+void            swapon(int);
+int             swapout(int);
+int             swapin(struct proc*, uint);
+int             swapdup(uint);
+void            swapfree(uint);
+void            rmapadd(pde_t*, uint, uint);
+void            rmapdel(pde_t*, uint, uint);
+int             isanon(uint);
+struct rmap*    rmaplist(uint);
+void            rmapmove(uint, uint);
+char*           kalloc_user(void);
+void            kswapinfo(struct swapinfo*);
+
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
@@ -183,11 +260,16 @@ int             deallocuvm(pde_t*, uint, uint);
 void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
 int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
-pde_t*          copyuvm(pde_t*, uint);
+pde_t*          copyuvm(struct proc*);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
+uint            uvmresident(pde_t*, uint, uint*);
+int             uvmpagein(struct proc*, uint, uint, int);
+void            uvmdroplarge(struct proc*, uint, uint, uint);
 void            page_fault_handler(uint);
+uint*           walkpgdir(pde_t*, const void*, int);
+int             mappages(pde_t*, void*, uint, uint, int);
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
\ No newline at end of file
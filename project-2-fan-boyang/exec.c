@@ -11,11 +11,12 @@ int
 exec(char *path, char **argv)
 {
   char *s, *last;
-  int i, off;
+  int i, off, nseg;
   uint argc, sz, sp, ustack[3+MAXARG+1];
   struct elfhdr elf;
-  struct inode *ip;
+  struct inode *ip, *exe, *oldexe;
   struct proghdr ph;
+  struct vmseg seg[NSEG];
   pde_t *pgdir, *oldpgdir;
   struct proc *curproc = myproc();
 
@@ -28,6 +29,7 @@ exec(char *path, char **argv)
   }
   ilock(ip);
   pgdir = 0;
+  exe = 0;
 
   // Check ELF header
   if(readi(ip, (char*)&elf, 0, sizeof(elf)) != sizeof(elf))
@@ -38,9 +40,11 @@ exec(char *path, char **argv)
   if((pgdir = setupkvm()) == 0)
     goto bad;
 
-  // Load program into memory.
+  // Record the program segments. Nothing is read yet:
+  // page_fault_handler() reads each page from ip on first use.
   // sz = 0;
   sz = PGSIZE;
+  nseg = 0;
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, (char*)&ph, off, sizeof(ph)) != sizeof(ph))
       goto bad;
@@ -50,23 +54,37 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr + ph.memsz < ph.vaddr)
       goto bad;
-    if((sz = allocuvm(pgdir, sz, ph.vaddr + ph.memsz)) == 0)
+    if(ph.vaddr + ph.memsz >= MMAPBASE)
       goto bad;
-    if(ph.vaddr % PGSIZE != 0)
+    if(ph.vaddr % PGSIZE != 0 || ph.vaddr < PGSIZE)
       goto bad;
-    if(loaduvm(pgdir, (char*)ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    if(nseg >= NSEG)
       goto bad;
+    seg[nseg].va = ph.vaddr;
+    seg[nseg].off = ph.off;
+    seg[nseg].filesz = ph.filesz;
+    seg[nseg].memsz = ph.memsz;
+    nseg++;
+    if(ph.vaddr + ph.memsz > sz)
+      sz = ph.vaddr + ph.memsz;
   }
-  iunlockput(ip);
+  idenywrite(ip);
+  iunlock(ip);
   end_op();
+  exe = ip;
   ip = 0;
 
-  // Allocate two pages at the next page boundary.
-  // Make the first inaccessible.  Use the second as the user stack.
+  // At the next page boundary, allocate an inaccessible guard
+  // page, then reserve USTACKPAGES of user stack above it but
+  // allocate only the top one. The rest are demand-zero, like
+  // the heap, so the stack grows into them as it is used.
   sz = PGROUNDUP(sz);
-  if((sz = allocuvm(pgdir, sz, sz + 2*PGSIZE)) == 0)
+  if(allocuvm(pgdir, sz, sz + PGSIZE) == 0)
+    goto bad;
+  clearpteu(pgdir, (char*)sz);
+  sz += PGSIZE + USTACKPAGES*PGSIZE;
+  if(sz >= MMAPBASE || allocuvm(pgdir, sz - PGSIZE, sz) == 0)
     goto bad;
-  clearpteu(pgdir, (char*)(sz - 2*PGSIZE));
   sp = sz;
 
   // Push argument strings, prepare rest of stack in ustack.
@@ -96,12 +114,24 @@ exec(char *path, char **argv)
 
   // Commit to the user image.
   oldpgdir = curproc->pgdir;
+  oldexe = curproc->exe;
   curproc->pgdir = pgdir;
   curproc->sz = sz;
+  curproc->exe = exe;
+  curproc->nseg = nseg;
+  curproc->seqstart = curproc->seqend = 0;
+  memmove(curproc->seg, seg, sizeof(seg));
   curproc->tf->eip = elf.entry;  // main
   curproc->tf->esp = sp;
   switchuvm(curproc);
+  munmapall(curproc, oldpgdir);
   freevm(oldpgdir);
+  if(oldexe){
+    iallowwrite(oldexe);
+    begin_op();
+    iput(oldexe);
+    end_op();
+  }
   return 0;
 
  bad:
@@ -111,5 +141,11 @@ exec(char *path, char **argv)
     iunlockput(ip);
     end_op();
   }
+  if(exe){
+    iallowwrite(exe);
+    begin_op();
+    iput(exe);
+    end_op();
+  }
   return -1;
 }
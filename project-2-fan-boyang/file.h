@@ -14,6 +14,8 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  int nexec;          // processes running it, which deny writes
+  struct inode *next; // icache hash chain
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
@@ -20,6 +20,7 @@
 #include "fs.h"
 #include "buf.h"
 #include "file.h"
+#include "slab.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 static void itrunc(struct inode*);
@@ -120,12 +121,11 @@ bfree(int dev, uint b)
 //   is non-zero. ialloc() allocates, and iput() frees if
 //   the reference and link counts have fallen to zero.
 //
-// * Referencing in cache: an entry in the inode cache
-//   is free if ip->ref is zero. Otherwise ip->ref tracks
-//   the number of in-memory pointers to the entry (open
-//   files and current directories). iget() finds or
-//   creates a cache entry and increments its ref; iput()
-//   decrements ref.
+// * Referencing in cache: ip->ref tracks the number of
+//   in-memory pointers to a cache entry (open files and
+//   current directories). iget() finds or creates a cache
+//   entry and increments its ref; iput() decrements ref,
+//   and frees the entry once ref reaches zero.
 //
 // * Valid: the information (type, size, &c) in an inode
 //   cache entry is only correct when ip->valid is 1.
@@ -155,29 +155,39 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
-// The icache.lock spin-lock protects the allocation of icache
-// entries. Since ip->ref indicates whether an entry is free,
-// and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold icache.lock while using any of those fields.
+// Cache entries come from an object cache and are found
+// through a hash table keyed on (dev, inum).
+// The icache.lock spin-lock protects the hash table and the
+// allocation of icache entries. Since ip->ref indicates whether
+// an entry is in use, and ip->dev and ip->inum indicate which
+// i-node an entry holds, one must hold icache.lock while using
+// any of those fields.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
+#define NIHASH 61
+#define IHASH(dev, inum) (((dev) * 31 + (inum)) % NIHASH)
+
 struct {
   struct spinlock lock;
-  struct inode inode[NINODE];
+  struct kmem_cache cache;
+  struct inode *hash[NIHASH];
 } icache;
 
+// Called from main(): userinit() needs the root inode
+// before the first process gets to run iinit().
 void
-iinit(int dev)
+icacheinit(void)
 {
-  int i = 0;
-  
   initlock(&icache.lock, "icache");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&icache.inode[i].lock, "inode");
-  }
+  kmem_cache_init(&icache.cache, "inode", sizeof(struct inode));
+}
+
+void
+iinit(int dev)
+{
 
   readsb(dev, &sb);
   cprintf("sb: size %d nblocks %d ninodes %d nlog %d logstart %d\
@@ -242,31 +252,31 @@ iupdate(struct inode *ip)
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip, **bucket;
 
   acquire(&icache.lock);
 
   // Is the inode already cached?
-  empty = 0;
-  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
+  bucket = &icache.hash[IHASH(dev, inum)];
+  for(ip = *bucket; ip; ip = ip->next){
+    if(ip->dev == dev && ip->inum == inum){
       ip->ref++;
       release(&icache.lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
   }
 
-  // Recycle an inode cache entry.
-  if(empty == 0)
+  // Create a new inode cache entry.
+  if((ip = kmem_cache_alloc(&icache.cache)) == 0)
     panic("iget: no inodes");
-
-  ip = empty;
+  initsleeplock(&ip->lock, "inode");
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ip->nexec = 0;
+  ip->next = *bucket;
+  *bucket = ip;
   release(&icache.lock);
 
   return ip;
@@ -283,6 +293,29 @@ idup(struct inode *ip)
   return ip;
 }
 
+// Deny writes to ip while a process runs it from its pages: one
+// call for each process whose exe it is. The caller must hold
+// ip's lock, so that no write is under way, or have writes
+// denied already.
+void
+idenywrite(struct inode *ip)
+{
+  acquire(&icache.lock);
+  ip->nexec++;
+  release(&icache.lock);
+}
+
+// Undo one idenywrite().
+void
+iallowwrite(struct inode *ip)
+{
+  acquire(&icache.lock);
+  if(ip->nexec < 1)
+    panic("iallowwrite");
+  ip->nexec--;
+  release(&icache.lock);
+}
+
 // Lock the given inode.
 // Reads the inode from disk if necessary.
 void
@@ -323,8 +356,8 @@ iunlock(struct inode *ip)
 }
 
 // Drop a reference to an in-memory inode.
-// If that was the last reference, the inode cache entry can
-// be recycled.
+// If that was the last reference, the inode cache entry is
+// freed.
 // If that was the last reference and the inode has no links
 // to it, free the inode (and its content) on disk.
 // All calls to iput() must be inside a transaction in
@@ -332,6 +365,8 @@ iunlock(struct inode *ip)
 void
 iput(struct inode *ip)
 {
+  struct inode **pp;
+
   acquiresleep(&ip->lock);
   if(ip->valid && ip->nlink == 0){
     acquire(&icache.lock);
@@ -348,8 +383,15 @@ iput(struct inode *ip)
   releasesleep(&ip->lock);
 
   acquire(&icache.lock);
-  ip->ref--;
+  if(--ip->ref > 0){
+    release(&icache.lock);
+    return;
+  }
+  for(pp = &icache.hash[IHASH(ip->dev, ip->inum)]; *pp != ip; pp = &(*pp)->next)
+    ;
+  *pp = ip->next;
   release(&icache.lock);
+  kmem_cache_free(&icache.cache, ip);
 }
 
 // Common idiom: unlock, then put.
@@ -412,6 +454,7 @@ itrunc(struct inode *ip)
   struct buf *bp;
   uint *a;
 
+  pcache_invalidate(ip);
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
@@ -473,6 +516,7 @@ readi(struct inode *ip, char *dst, uint off, uint n)
     memmove(dst, bp->data + off%BSIZE, m);
     brelse(bp);
   }
+  pcache_read(ip, dst - n, off - n, n);
   return n;
 }
 
@@ -495,6 +539,10 @@ writei(struct inode *ip, char *src, uint off, uint n)
     return -1;
   if(off + n > MAXFILE*BSIZE)
     return -1;
+  // A running program reads its pages from the file for as long
+  // as it runs, and must not see part of a new one.
+  if(ip->nexec > 0)
+    return -1;
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
@@ -503,6 +551,7 @@ writei(struct inode *ip, char *src, uint off, uint n)
     log_write(bp);
     brelse(bp);
   }
+  pcache_write(ip, src - n, off - n, n);
 
   if(n > 0 && off > ip->size){
     ip->size = off;
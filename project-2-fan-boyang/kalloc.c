@@ -1,13 +1,46 @@
 // Physical memory allocator, intended to allocate
 // memory for user processes, kernel stacks, page table pages,
 // and pipe buffers. Allocates 4096-byte pages.
+//
+// Free memory is managed by a binary buddy allocator:
+// kalloc_pages(order) returns 2^order physically contiguous
+// pages, and kfree_pages() merges a freed block with its buddy
+// whenever the buddy is free too.
+//
+// Each CPU keeps a small cache of single free pages so that
+// kalloc() and kfree() normally touch only that CPU's cache lock.
+// Pages move between a cache and the buddy allocator KBATCH at
+// a time; a CPU that finds both its cache and the buddy
+// allocator empty steals half of another CPU's cache.
+//
+// Idle CPUs fill a pool of pre-zeroed pages (kzeroidle(), called
+// from the scheduler) which kalloc_zeroed() hands out, so page
+// tables and fresh user memory need not be cleared on the fault
+// and fork paths. Freed pages are only junk-filled in
+// KALLOC_DEBUG builds.
 
 #include "types.h"
 #include "defs.h"
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "x86.h"
 #include "spinlock.h"
+#include "buddyinfo.h"
+#include "vmstat.h"
+
+#define KBATCH     32          // pages moved to or from the buddy lists at once
+#define KCACHEMAX  (2*KBATCH)  // a CPU cache drains above this many pages
+#define NZEROMAX   128         // pre-zeroed pages kept by idle CPUs
+
+#define NPAGE      (PHYSTOP/PGSIZE)
+#define PFN(v)     (V2P(v)/PGSIZE)
+#define PFN2V(pfn) ((struct run*)P2V((pfn)*PGSIZE))
+
+// PG_FREE marks the first page of a block on a buddy free list.
+// PG_PERM marks a page from kalloc_perm().
+#define PG_FREE    0x80
+#define PG_PERM    0x40
 
 void freerange(void *vstart, void *vend);
 extern char end[]; // first address after kernel loaded from ELF file
@@ -15,24 +48,68 @@ extern char end[]; // first address after kernel loaded from ELF file
 
 struct run {
   struct run *next;
+  struct run *prev;  // only used on the buddy free lists
+};
+
+// Metadata for one physical page, indexed by page number.
+struct page {
+  ushort ref;   // references to an allocated page; updated atomically
+  uchar info;   // buddy order of a block's first page, PG_FREE, PG_PERM
+};
+
+// Allocation latency samples, in rdtsc cycles.
+struct latency {
+  uint n;
+  uint nfail;
+  uint avg;  // moving average over roughly the last 16 samples
+  uint max;
+};
+
+// Free pages cached by one CPU. Only the owning CPU adds
+// pages; other CPUs take the lock only to steal.
+struct kcache {
+  struct spinlock lock;
+  struct run *freelist;
+  int nfree;
+  struct latency lat;  // kalloc() on this CPU; written only by it
+  int count[NVMCOUNT]; // vmcount() on this CPU; likewise
 };
 
 struct {
   struct spinlock lock;
   int use_lock;
-  struct run *freelist;
-  uint page_reference_count[PHYSTOP/PGSIZE];
+  struct run *freelist[MAXORDER+1];  // buddy free lists
+  uint nfree[MAXORDER+1];
+  struct latency lat[MAXORDER+1];    // kalloc_pages(), order >= 1
+  struct kcache cache[NCPU];
+  struct page pages[NPAGE];
+  uint ntotal;                       // pages handed in by freerange()
 } kmem;
 
+// Pool of allocated, zero-filled pages. Only the first word of
+// each page (the list link) is dirty while it sits in the pool.
+struct {
+  struct spinlock lock;
+  struct run *list;
+  int n;
+} zpool;
+
 // Initialization happens in two phases.
 // 1. main() calls kinit1() while still using entrypgdir to place just
 // the pages mapped by entrypgdir on free list.
 // 2. main() calls kinit2() with the rest of the physical pages
 // after installing a full page table that maps them on all cores.
+// Until kinit2() is done the per-CPU caches are bypassed, since
+// mycpu() does not work before lapicinit().
 void
 kinit1(void *vstart, void *vend)
 {
+  int i;
+
   initlock(&kmem.lock, "kmem");
+  for(i = 0; i < NCPU; i++)
+    initlock(&kmem.cache[i].lock, "kcache");
+  initlock(&zpool.lock, "zpool");
   kmem.use_lock = 0;
   freerange(vstart, vend);
 }
@@ -51,8 +128,195 @@ freerange(void *vstart, void *vend)
   p = (char*)PGROUNDUP((uint)vstart);
   for(; p + PGSIZE <= (char*)vend; p += PGSIZE){
     kfree(p);
+    kmem.ntotal++;
+  }
+}
+
+static void
+latency_add(struct latency *l, uint t0, int ok)
+{
+  uint t;
+
+  if(!ok){
+    l->nfail++;
+    return;
+  }
+  t = rdtsc() - t0;
+  if(l->n++ == 0)
+    l->avg = t;
+  else
+    l->avg = l->avg - l->avg/16 + t/16;
+  if(t > l->max)
+    l->max = t;
+}
+
+//PAGEBREAK!
+// Buddy free lists. All of these require kmem.lock
+// (or !kmem.use_lock during boot).
+
+static void
+buddy_insert(uint pfn, int order)
+{
+  struct run *r;
+
+  r = PFN2V(pfn);
+  r->prev = 0;
+  r->next = kmem.freelist[order];
+  if(r->next)
+    r->next->prev = r;
+  kmem.freelist[order] = r;
+  kmem.nfree[order]++;
+  kmem.pages[pfn].info = PG_FREE | order;
+}
+
+static void
+buddy_remove(uint pfn, int order)
+{
+  struct run *r;
+
+  r = PFN2V(pfn);
+  if(r->prev)
+    r->prev->next = r->next;
+  else
+    kmem.freelist[order] = r->next;
+  if(r->next)
+    r->next->prev = r->prev;
+  kmem.nfree[order]--;
+  kmem.pages[pfn].info = order;
+}
+
+// Take a block of 2^order pages off the free lists,
+// splitting a larger block if necessary.
+static struct run*
+buddy_alloc(int order)
+{
+  int k;
+  uint pfn;
+
+  for(k = order; k <= MAXORDER && kmem.freelist[k] == 0; k++)
+    ;
+  if(k > MAXORDER)
+    return 0;
+  pfn = PFN(kmem.freelist[k]);
+  buddy_remove(pfn, k);
+  // Give back the upper half until the block is the right size.
+  while(k > order){
+    k--;
+    buddy_insert(pfn + (1 << k), k);
+  }
+  kmem.pages[pfn].info = order;
+  return PFN2V(pfn);
+}
+
+// Return a block to the free lists, merging it with its buddy
+// for as long as the buddy is a free block of the same order.
+// Pages below the kernel's end are never marked free, and
+// PHYSTOP is a multiple of the largest block, so a buddy is
+// always a valid page number.
+static void
+buddy_free(struct run *r, int order)
+{
+  uint pfn, buddy;
+
+  pfn = PFN(r);
+  while(order < MAXORDER){
+    buddy = pfn ^ (1 << order);
+    if(kmem.pages[buddy].info != (PG_FREE | order))
+      break;
+    buddy_remove(buddy, order);
+    pfn &= ~(1 << order);
+    order++;
+  }
+  buddy_insert(pfn, order);
+}
+
+//PAGEBREAK!
+// Per-CPU caches.
+
+// Move up to n pages from the list *from to the list *to.
+// Returns the number of pages moved.
+static int
+kmove(struct run **to, struct run **from, int n)
+{
+  struct run *r;
+  int i;
+
+  for(i = 0; i < n && (r = *from) != 0; i++){
+    *from = r->next;
+    r->next = *to;
+    *to = r;
+  }
+  return i;
+}
+
+// Take half of some other CPU's cache onto *list.
+// Called holding no kmem locks.
+static int
+ksteal(struct kcache *kc, struct run **list)
+{
+  struct kcache *victim;
+  int n;
+
+  for(victim = kmem.cache; victim < &kmem.cache[NCPU]; victim++){
+    if(victim == kc || victim->nfree == 0)
+      continue;
+    acquire(&victim->lock);
+    n = kmove(list, &victim->freelist, (victim->nfree + 1) / 2);
+    victim->nfree -= n;
+    release(&victim->lock);
+    if(n > 0)
+      return n;
   }
+  return 0;
 }
+
+// Refill the empty cache kc with a batch of pages, from the
+// buddy allocator if possible and from another CPU otherwise.
+// Returns one page for the caller, or 0 if memory is exhausted.
+// Called with interrupts off and holding no kmem locks.
+static struct run*
+krefill(struct kcache *kc)
+{
+  struct run *r, *batch;
+  int n;
+
+  batch = 0;
+  acquire(&kmem.lock);
+  for(n = 0; n < KBATCH && (r = buddy_alloc(0)) != 0; n++){
+    r->next = batch;
+    batch = r;
+  }
+  release(&kmem.lock);
+  if(n == 0 && (n = ksteal(kc, &batch)) == 0)
+    return 0;
+
+  r = batch;
+  batch = r->next;
+  if(--n > 0){
+    acquire(&kc->lock);
+    kmove(&kc->freelist, &batch, n);
+    kc->nfree += n;
+    release(&kc->lock);
+  }
+  return r;
+}
+
+// Take a page from the zero pool; it is already referenced.
+static struct run*
+zpool_pop(void)
+{
+  struct run *r;
+
+  acquire(&zpool.lock);
+  r = zpool.list;
+  if(r){
+    zpool.list = r->next;
+    zpool.n--;
+  }
+  release(&zpool.lock);
+  return r;
+}
+
 //PAGEBREAK: 21
 // Free the page of physical memory pointed at by v,
 // which normally should have been returned by a
@@ -61,31 +325,63 @@ freerange(void *vstart, void *vend)
 void
 kfree(char *v)
 {
-  struct run *r;
+  struct kcache *kc;
+  struct run *r, *batch;
+  int n;
 
   if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
     panic("kfree");
+  if(kmem.pages[PFN(v)].info & PG_PERM)
+    return;
 
-  // Fill with junk to catch dangling refs.
+  // Drop one reference; only whoever drops the last one frees
+  // the page. freerange() hands in pages that were never
+  // allocated, so skip the count during boot.
+  if(kmem.use_lock){
+    switch(xaddw(&kmem.pages[PFN(v)].ref, -1)){
+    case 0:
+      panic("kfree: free page");
+    case 1:
+      break;
+    default:
+      return;
+    }
+  }
 
-  if(kmem.use_lock)
-    acquire(&kmem.lock);
+#ifdef KALLOC_DEBUG
+  // Fill with junk to catch dangling refs.
+  memset(v, 1, PGSIZE);
+#endif
 
-  uint p_address = V2P(v);
-  if( kmem.page_reference_count[p_address/PGSIZE] >= 2 )
-    kmem.page_reference_count[p_address/PGSIZE]--;
-  else if( kmem.page_reference_count[p_address/PGSIZE] == 1 || kmem.page_reference_count[p_address/PGSIZE] == 0 ){
-    kmem.page_reference_count[p_address/PGSIZE] = 0;
-    memset(v, 1, PGSIZE);
-    r = (struct run*)v;
-    r->next = kmem.freelist;
-    kmem.freelist = r;
+  r = (struct run*)v;
+  if(!kmem.use_lock){
+    buddy_free(r, 0);
+    return;
   }
 
+  pushcli();
+  kc = &kmem.cache[cpuid()];
+  kc->count[VM_FREE]++;
+  acquire(&kc->lock);
+  r->next = kc->freelist;
+  kc->freelist = r;
+  batch = 0;
+  n = 0;
+  if(++kc->nfree > KCACHEMAX){
+    n = kmove(&batch, &kc->freelist, KBATCH);
+    kc->nfree -= n;
+  }
+  release(&kc->lock);
 
-
-  if(kmem.use_lock)
+  if(n > 0){
+    acquire(&kmem.lock);
+    while((r = batch) != 0){
+      batch = r->next;
+      buddy_free(r, 0);
+    }
     release(&kmem.lock);
+  }
+  popcli();
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -94,40 +390,233 @@ kfree(char *v)
 char*
 kalloc(void)
 {
+  struct kcache *kc;
   struct run *r;
+  uint t0;
 
-  if(kmem.use_lock)
-    acquire(&kmem.lock);
-  r = kmem.freelist;
+  if(!kmem.use_lock){
+    r = buddy_alloc(0);
+    if(r)
+      kmem.pages[PFN(r)].ref = 1;
+    return (char*)r;
+  }
+
+  t0 = rdtsc();
+  pushcli();
+  kc = &kmem.cache[cpuid()];
+  acquire(&kc->lock);
+  r = kc->freelist;
   if(r){
-    kmem.freelist = r->next;
-    kmem.page_reference_count[V2P( (char*)r )/PGSIZE] = 1;
+    kc->freelist = r->next;
+    kc->nfree--;
+  }
+  release(&kc->lock);
+  if(r == 0)
+    r = krefill(kc);
+  if(r == 0)
+    r = zpool_pop();
+  latency_add(&kc->lat, t0, r != 0);
+  if(r)
+    kc->count[VM_ALLOC]++;
+  popcli();
+  // No one else can see a free page, so no lock is needed.
+  if(r)
+    kmem.pages[PFN(r)].ref = 1;
+  else if(pcache_reclaim() > 0)
+    return kalloc();
+  return (char*)r;
+}
+
+// Allocate one zero-filled page, preferably one cleared
+// ahead of time by an idle CPU.
+char*
+kalloc_zeroed(void)
+{
+  struct run *r;
+
+  if(kmem.use_lock && (r = zpool_pop()) != 0){
+    r->next = 0;
+    return (char*)r;
   }
+  if((r = (struct run*)kalloc()) != 0)
+    memset(r, 0, PGSIZE);
+  return (char*)r;
+}
+
+// Allocate a zero-filled page that is never freed, such as the
+// zero page vm.c maps copy-on-write for untouched memory. Any
+// number of PTEs may map it, more than a reference count can
+// hold, so it keeps no count: kfree() and inc_ref_count()
+// ignore it, and get_ref_count() reads 0 for it.
+char*
+kalloc_perm(void)
+{
+  char *v;
+
+  if((v = kalloc_zeroed()) != 0)
+    kmem.pages[PFN(v)].info |= PG_PERM;
+  return v;
+}
+
+// Called by the scheduler when it found nothing to run:
+// clear one more page for the zero pool, unless it is full.
+void
+kzeroidle(void)
+{
+  struct run *r;
+
+  if(zpool.n >= NZEROMAX)
+    return;
+  if((r = (struct run*)kalloc()) == 0)
+    return;
+  memset(r, 0, PGSIZE);
+  acquire(&zpool.lock);
+  r->next = zpool.list;
+  zpool.list = r;
+  zpool.n++;
+  release(&zpool.lock);
+}
+
+// Allocate 2^order physically contiguous pages, 0 <= order <= MAXORDER.
+// Returns the kernel address of the first page, or 0.
+char*
+kalloc_pages(int order)
+{
+  struct run *r;
+  uint t0;
+
+  if(order < 0 || order > MAXORDER)
+    panic("kalloc_pages");
+  if(order == 0)
+    return kalloc();
+
+  t0 = rdtsc();
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  r = buddy_alloc(order);
+  latency_add(&kmem.lat[order], t0, r != 0);
+  if(r)
+    kmem.pages[PFN(r)].ref = 1;
   if(kmem.use_lock)
     release(&kmem.lock);
+  if(r)
+    vmcount(VM_ALLOC, 1 << order);
   return (char*)r;
 }
 
+// Free a block returned by kalloc_pages(order).
 void
-inc_ref_count(uint pa){
+kfree_pages(char *v, int order)
+{
+  if((uint)v % (PGSIZE << order) || v < end || V2P(v) >= PHYSTOP)
+    panic("kfree_pages");
+  if(order == 0){
+    kfree(v);
+    return;
+  }
+
+#ifdef KALLOC_DEBUG
+  memset(v, 1, PGSIZE << order);
+#endif
+
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  if(kmem.pages[PFN(v)].info != order)
+    panic("kfree_pages: wrong order");
+  kmem.pages[PFN(v)].ref = 0;
+  buddy_free((struct run*)v, order);
+  if(kmem.use_lock)
+    release(&kmem.lock);
+  vmcount(VM_FREE, 1 << order);
+}
+
+// Copy allocator statistics out for the buddyinfo system call.
+void
+kbuddyinfo(struct buddyinfo *bi)
+{
+  struct kcache *kc;
+  struct latency *l;
+  uint avgsum;
+  int k;
+
+  memset(bi, 0, sizeof(*bi));
+  avgsum = 0;
+  bi->nzero = zpool.n;
+  for(kc = kmem.cache; kc < &kmem.cache[NCPU]; kc++){
+    bi->ncached += kc->nfree;
+    bi->nalloc[0] += kc->lat.n;
+    bi->nfail[0] += kc->lat.nfail;
+    if(kc->lat.max > bi->maxcycles[0])
+      bi->maxcycles[0] = kc->lat.max;
+    if(kc->lat.n > 0){
+      bi->avgcycles[0] += kc->lat.avg;
+      avgsum++;
+    }
+  }
+  if(avgsum > 0)
+    bi->avgcycles[0] /= avgsum;
+
   acquire(&kmem.lock);
-  kmem.page_reference_count[pa/PGSIZE]++;
+  for(k = 0; k <= MAXORDER; k++){
+    bi->nfree[k] = kmem.nfree[k];
+    if(k == 0)
+      continue;
+    l = &kmem.lat[k];
+    bi->nalloc[k] = l->n;
+    bi->nfail[k] = l->nfail;
+    bi->avgcycles[k] = l->avg;
+    bi->maxcycles[k] = l->max;
+  }
   release(&kmem.lock);
+}
 
+// Add n to this CPU's count of event i, from vmstat.h.
+void
+vmcount(int i, int n)
+{
+  if(!kmem.use_lock)
+    return;
+  pushcli();
+  kmem.cache[cpuid()].count[i] += n;
+  popcli();
 }
 
+// Sum the per-CPU counters and take a snapshot of where memory
+// is, for the vmstat system call.
 void
-dec_ref_count(uint pa){
+kvmstat(struct vmstat *vs)
+{
+  struct kcache *kc;
+  int i, k;
+
+  memset(vs, 0, sizeof(*vs));
+  vs->ntotal = kmem.ntotal;
+  vs->nzero = zpool.n;
+  for(kc = kmem.cache; kc < &kmem.cache[NCPU]; kc++){
+    vs->nfree += kc->nfree;
+    for(i = 0; i < NVMCOUNT; i++)
+      vs->count[i] += kc->count[i];
+  }
   acquire(&kmem.lock);
-  kmem.page_reference_count[pa/PGSIZE]--;
+  for(k = 0; k <= MAXORDER; k++)
+    vs->nfree += kmem.nfree[k] << k;
   release(&kmem.lock);
+  vs->npcache = pcache_count();
+  vs->nbuf = bcache_count();
+}
 
+// Add a reference to the page at physical address pa.
+// References are dropped with kfree().
+void
+inc_ref_count(uint pa){
+  if(kmem.pages[pa/PGSIZE].info & PG_PERM)
+    return;
+  xaddw(&kmem.pages[pa/PGSIZE].ref, 1);
 }
 
 uint
 get_ref_count(uint pa){
-  acquire(&kmem.lock);
-  uint count = kmem.page_reference_count[pa/PGSIZE];
-  release(&kmem.lock);
-  return count;
-}
\ No newline at end of file
+  if(kmem.pages[pa/PGSIZE].info & PG_PERM)
+    return 0;
+  return *(volatile ushort*)&kmem.pages[pa/PGSIZE].ref;
+}
@@ -0,0 +1,174 @@
+// Same-page merging.
+//
+// Forked workers, and programs filling buffers with the same
+// tables, often end up with many anonymous pages of identical
+// content. When a CPU finds nothing to run, ksmidle() hashes a
+// few more anonymous pages, walking physical memory with a
+// hand of its own, and remembers each page's hash in a small
+// table. A page whose hash matches the one remembered in its
+// table entry is compared with that page word for word, and if
+// they are equal every PTE of the new page is pointed at the
+// old one, all of them read-only and PTE_COW, and the new page
+// is freed. A write to a merged page then takes an ordinary
+// copy-on-write fault.
+//
+// The table only ever holds hints: the page an entry names may
+// have been written, freed or reused since, which the compare
+// catches. A page stops taking merges at MAXPGREF references,
+// which leaves fork() room below the 16-bit count's limit; at
+// that point fork() copies the page instead of sharing it.
+// Merging happens under vmlock and ptable.lock, and
+// only while no process mapping either page is running, so
+// neither can change between the compare and the remap.
+//
+// Scanning is off until ksmctl() sets a rate, in pages per
+// clock tick; each idle call does at most KSMBATCH of them so
+// a process becoming runnable waits little.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "rmap.h"
+#include "ksminfo.h"
+
+#define NPAGE    (PHYSTOP/PGSIZE)
+#define NKSMHASH 1024   // remembered pages
+#define KSMBATCH 16     // pages scanned per idle call
+
+static struct {
+  struct {
+    uint pfn;
+    uint hash;
+  } table[NKSMHASH];
+  uint hand;      // page the scan looks at next
+  uint tick;      // tick the budget was last refilled
+  uint budget;    // pages left to scan this tick
+  uint rate;
+  uint nscan;
+  uint nmerged;
+} ksm;
+
+static uint
+pagehash(uint *w)
+{
+  uint h, i;
+
+  h = 2166136261;
+  for(i = 0; i < PGSIZE/sizeof(uint); i++)
+    h = (h ^ w[i]) * 16777619;
+  return h;
+}
+
+// Can anonymous page pfn be merged? Every reference to it must
+// be a mapping, and no process mapping it may be running.
+// Returns the number of mappings, or 0. Caller must hold vmlock
+// and ptable.lock.
+static uint
+mergeable(uint pfn)
+{
+  struct rmap *e;
+  uint nmap;
+
+  nmap = 0;
+  for(e = rmaplist(pfn*PGSIZE); e; e = e->next){
+    if(!pageoutok(e->pgdir, e->va))
+      return 0;
+    nmap++;
+  }
+  if(nmap == 0 || get_ref_count(pfn*PGSIZE) != nmap)
+    return 0;
+  return nmap;
+}
+
+// Point every mapping of page dup at page keep, read-only and
+// copy-on-write, and free dup.
+static void
+merge(uint keep, uint dup, uint ndup)
+{
+  struct rmap *e;
+  pte_t *pte;
+  uint i;
+
+  for(e = rmaplist(keep*PGSIZE); e; e = e->next){
+    pte = walkpgdir(e->pgdir, (char*)e->va, 0);
+    if(*pte & PTE_W)
+      *pte = (*pte & ~PTE_W) | PTE_COW;
+  }
+  for(e = rmaplist(dup*PGSIZE); e; e = e->next){
+    pte = walkpgdir(e->pgdir, (char*)e->va, 0);
+    *pte = keep*PGSIZE | (PTE_FLAGS(*pte) & ~(PTE_W|PTE_A|PTE_D)) | PTE_COW;
+    inc_ref_count(keep*PGSIZE);
+  }
+  rmapmove(dup*PGSIZE, keep*PGSIZE);
+  for(i = 0; i < ndup; i++)
+    kfree(P2V(dup*PGSIZE));
+  ksm.nmerged++;
+}
+
+// Hash page pfn and merge it into the page remembered under
+// the same hash if the two are equal.
+static void
+ksmscan(uint pfn)
+{
+  uint h, n, old;
+  char *a;
+
+  ptablelock();
+  if((n = mergeable(pfn)) == 0){
+    ptableunlock();
+    return;
+  }
+  ksm.nscan++;
+  a = P2V(pfn*PGSIZE);
+  h = pagehash((uint*)a);
+  old = ksm.table[h % NKSMHASH].pfn;
+  if(old != pfn && ksm.table[h % NKSMHASH].hash == h &&
+     mergeable(old) && get_ref_count(old*PGSIZE) + n <= MAXPGREF &&
+     memcmp(a, P2V(old*PGSIZE), PGSIZE) == 0){
+    merge(old, pfn, n);
+  } else {
+    ksm.table[h % NKSMHASH].pfn = pfn;
+    ksm.table[h % NKSMHASH].hash = h;
+  }
+  ptableunlock();
+}
+
+// Called by the scheduler when it found nothing to run.
+void
+ksmidle(void)
+{
+  uint n, pfn;
+
+  if(ksm.rate == 0)
+    return;
+  acquire(&vmlock);
+  if(ksm.tick != ticks){
+    ksm.tick = ticks;
+    ksm.budget = ksm.rate;
+  }
+  for(n = 0; n < KSMBATCH && ksm.budget > 0; n++){
+    ksm.budget--;
+    pfn = ksm.hand;
+    ksm.hand = (ksm.hand + 1) % NPAGE;
+    if(isanon(pfn*PGSIZE))
+      ksmscan(pfn);
+  }
+  release(&vmlock);
+}
+
+// Set the scan rate in pages per tick, unless rate is negative,
+// and report the activity so far.
+void
+ksmctl(int rate, struct ksminfo *ki)
+{
+  acquire(&vmlock);
+  if(rate >= 0)
+    ksm.rate = rate;
+  ki->rate = ksm.rate;
+  ki->nscan = ksm.nscan;
+  ki->nmerged = ksm.nmerged;
+  release(&vmlock);
+}
@@ -0,0 +1,11 @@
+#ifndef _KSMINFO_H_
+#define _KSMINFO_H_
+
+// Same-page merging activity since boot.
+struct ksminfo {
+  uint rate;      // physical pages looked at per tick; 0 is off
+  uint nscan;     // anonymous pages hashed
+  uint nmerged;   // pages freed by merging them into an identical one
+};
+
+#endif //_KSMINFO_H_
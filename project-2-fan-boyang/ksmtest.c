@@ -0,0 +1,126 @@
+// Same-page merging test.
+// Forks NWORK workers that each fill NPAGES heap pages with the
+// same contents and then block, turns merging on and waits
+// until the scanner has merged the copies, printing how many
+// pages that gave back. Then lets the workers check their
+// pages, write to them, which must copy them again, and check
+// them once more.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "buddyinfo.h"
+#include "ksminfo.h"
+
+#define PGSIZE  4096
+#define NWORK   4
+#define NPAGES  64
+#define RATE    4096    // pages scanned per tick
+#define TIMEOUT 1000    // ticks to wait for the merges
+
+int
+freepages(void)
+{
+  struct buddyinfo bi;
+  int k, n;
+
+  if(buddyinfo(&bi) < 0){
+    printf(1, "ksmtest: buddyinfo failed\n");
+    exit();
+  }
+  n = bi.ncached;
+  for(k = 0; k <= MAXORDER; k++)
+    n += bi.nfree[k] << k;
+  return n;
+}
+
+void
+check(char *heap, int seed, char *when)
+{
+  int i, j;
+
+  for(i = 0; i < NPAGES; i++){
+    for(j = 0; j < PGSIZE; j += sizeof(int)){
+      if(*(int*)(heap + i*PGSIZE + j) != (i*PGSIZE + j) * seed){
+        printf(1, "ksmtest: %s: page %d offset %d is wrong\n", when, i, j);
+        exit();
+      }
+    }
+  }
+}
+
+void
+fill(char *heap, int seed)
+{
+  int i, j;
+
+  for(i = 0; i < NPAGES; i++)
+    for(j = 0; j < PGSIZE; j += sizeof(int))
+      *(int*)(heap + i*PGSIZE + j) = (i*PGSIZE + j) * seed;
+}
+
+// Fill the heap, report, and block until the parent says go.
+void
+worker(int ready, int go)
+{
+  char *heap, c;
+
+  if((heap = sbrk(NPAGES*PGSIZE)) == (char*)-1){
+    printf(1, "ksmtest: sbrk failed\n");
+    exit();
+  }
+  fill(heap, 3);
+  write(ready, "x", 1);
+  read(go, &c, 1);
+  check(heap, 3, "after merging");
+  fill(heap, 5);
+  check(heap, 5, "after writing");
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct ksminfo before, after;
+  int ready[2], go[2], i, start, free0;
+  char c;
+
+  if(pipe(ready) < 0 || pipe(go) < 0){
+    printf(1, "ksmtest: pipe failed\n");
+    exit();
+  }
+  for(i = 0; i < NWORK; i++){
+    if(fork() == 0){
+      close(ready[0]);
+      close(go[1]);
+      worker(ready[1], go[0]);
+    }
+  }
+  close(ready[1]);
+  close(go[0]);
+  for(i = 0; i < NWORK; i++)
+    read(ready[0], &c, 1);
+
+  free0 = freepages();
+  ksmctl(RATE, &before);
+  start = uptime();
+  do {
+    sleep(10);
+    ksmctl(-1, &after);
+  } while(after.nmerged - before.nmerged < (NWORK-1)*NPAGES &&
+          uptime() - start < TIMEOUT);
+  ksmctl(0, &after);
+  printf(1, "ksmtest: scanned %d pages, merged %d in %d ticks, %d pages freed\n",
+         after.nscan - before.nscan, after.nmerged - before.nmerged,
+         uptime() - start, freepages() - free0);
+  if(after.nmerged - before.nmerged < (NWORK-1)*NPAGES){
+    printf(1, "ksmtest: expected at least %d merges\n", (NWORK-1)*NPAGES);
+    exit();
+  }
+
+  close(go[1]);
+  for(i = 0; i < NWORK; i++)
+    wait();
+  printf(1, "ksmtest ok\n");
+  exit();
+}
@@ -0,0 +1,85 @@
+// Demand-zero sbrk() test.
+// Reserves a large heap, touches a sparse subset of it and
+// checks that only the touched pages become resident, that
+// untouched pages read as zero, and that fork() and shrinking
+// the heap cope with pages that were never allocated. Pages
+// that are only read map the shared zero page; "zero" is how
+// many pages that saves.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "procmem.h"
+
+#define PGSIZE  4096
+#define NPAGES  1024   // 4 MB of heap
+#define STRIDE  16     // touch one page in STRIDE
+
+void
+show(char *what)
+{
+  struct procmem pm;
+
+  if(procmem(&pm) < 0){
+    printf(1, "lazytest: procmem failed\n");
+    exit();
+  }
+  printf(1, "%s: reserved %d resident %d zero %d zfod %d pagein %d shared %d\n",
+         what, pm.reserved, pm.resident, pm.nzero, pm.nzfod, pm.npagein,
+         pm.nshared);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct procmem pm;
+  char *heap;
+  int i, start, pid;
+
+  show("start");
+  start = uptime();
+  heap = sbrk(NPAGES * PGSIZE);
+  if(heap == (char*)-1){
+    printf(1, "lazytest: sbrk failed\n");
+    exit();
+  }
+  printf(1, "sbrk of %d pages took %d ticks\n", NPAGES, uptime() - start);
+  show("after sbrk");
+
+  for(i = 0; i < NPAGES; i += STRIDE)
+    heap[i * PGSIZE] = i;
+  show("after touching");
+
+  for(i = 0; i < NPAGES; i++){
+    if(heap[i * PGSIZE + 1] != 0 ||
+       heap[i * PGSIZE] != (i % STRIDE == 0 ? (char)i : 0)){
+      printf(1, "lazytest: page %d has wrong contents\n", i);
+      exit();
+    }
+  }
+  show("after reading all");
+  if(procmem(&pm) < 0 || pm.nzero < NPAGES - NPAGES / STRIDE){
+    printf(1, "lazytest: untouched pages read without the zero page\n");
+    exit();
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf(1, "lazytest: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    heap[(NPAGES - 1) * PGSIZE] = 1;
+    show("child");
+    exit();
+  }
+  wait();
+
+  if(sbrk(-(NPAGES / 2) * PGSIZE) == (char*)-1){
+    printf(1, "lazytest: sbrk shrink failed\n");
+    exit();
+  }
+  show("after shrink");
+  printf(1, "lazytest ok\n");
+  exit();
+}
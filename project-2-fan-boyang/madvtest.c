@@ -0,0 +1,132 @@
+// madvise() test.
+// Checks that MADV_DONTNEED frees heap pages, which then read
+// as zero, that MADV_WILLNEED brings them back, that free()
+// gives big blocks back to the kernel, that malloc() can
+// reuse them afterwards, that read() and write() work on a
+// buffer in a 4 MB large page, and that MADV_DONTNEED frees a
+// large page it covers and zeroes one it only partly covers,
+// as does shrinking the heap into one.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "mman.h"
+#include "procmem.h"
+
+#define PGSIZE  4096
+#define NPAGES  256
+#define LGPGSIZE (4*1024*1024)
+
+int
+resident(void)
+{
+  struct procmem pm;
+
+  if(procmem(&pm) < 0){
+    printf(1, "madvtest: procmem failed\n");
+    exit();
+  }
+  return pm.resident;
+}
+
+void
+fail(char *why)
+{
+  printf(1, "madvtest: %s\n", why);
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *heap, *p;
+  int i, fd, before, touched;
+  uint cur;
+
+  heap = sbrk(NPAGES * PGSIZE);
+  if(heap == (char*)-1)
+    fail("sbrk failed");
+  before = resident();
+  for(i = 0; i < NPAGES; i++)
+    heap[i * PGSIZE] = 1;
+  touched = resident();
+  if(madvise(heap, NPAGES * PGSIZE, MADV_DONTNEED) < 0)
+    fail("MADV_DONTNEED failed");
+  printf(1, "DONTNEED: resident %d -> %d -> %d\n", before, touched, resident());
+  if(resident() > before)
+    fail("MADV_DONTNEED kept pages");
+  for(i = 0; i < NPAGES; i++)
+    if(heap[i * PGSIZE] != 0)
+      fail("freed page did not read as zero");
+  if(madvise(heap, NPAGES * PGSIZE, MADV_WILLNEED) < 0)
+    fail("MADV_WILLNEED failed");
+  if(madvise(heap + 1, PGSIZE, MADV_DONTNEED) == 0)
+    fail("unaligned madvise succeeded");
+  if(madvise(heap, 0x7fffffff, MADV_DONTNEED) == 0)
+    fail("madvise past the heap succeeded");
+  if(madvise(heap, PGSIZE, 99) == 0)
+    fail("bad advice succeeded");
+
+  p = malloc(NPAGES * PGSIZE);
+  if(p == 0)
+    fail("malloc failed");
+  before = resident();
+  memset(p, 7, NPAGES * PGSIZE);
+  touched = resident();
+  free(p);
+  printf(1, "free: resident %d -> %d -> %d\n", before, touched, resident());
+  if(resident() > before + 2)
+    fail("free kept the pages of a big block");
+  p = malloc(NPAGES * PGSIZE);
+  if(p == 0)
+    fail("malloc after free failed");
+  memset(p, 9, NPAGES * PGSIZE);
+  for(i = 0; i < NPAGES * PGSIZE; i += PGSIZE)
+    if(p[i] != 9)
+      fail("reused block has wrong contents");
+  free(p);
+
+  // Two large pages, starting on a 4 MB boundary.
+  largepages(1);
+  cur = (uint)sbrk(0);
+  if(sbrk((LGPGSIZE - cur % LGPGSIZE) % LGPGSIZE) == (char*)-1 ||
+     (heap = sbrk(2 * LGPGSIZE)) == (char*)-1)
+    fail("sbrk for large pages failed");
+  before = resident();
+  for(i = 0; i < 2 * LGPGSIZE; i += PGSIZE)
+    heap[i] = 5;
+  touched = resident();
+  // System calls can use a buffer in a large page.
+  if((fd = open("madvfile", O_CREATE|O_RDWR)) < 0)
+    fail("open failed");
+  if(write(fd, heap + LGPGSIZE + PGSIZE, PGSIZE) != PGSIZE)
+    fail("write from a large page failed");
+  close(fd);
+  if((fd = open("madvfile", O_RDONLY)) < 0 ||
+     read(fd, heap + 8, PGSIZE) != PGSIZE || heap[8] != 5)
+    fail("read into a large page failed");
+  close(fd);
+  unlink("madvfile");
+  if(madvise(heap, LGPGSIZE + PGSIZE, MADV_DONTNEED) < 0)
+    fail("MADV_DONTNEED on large pages failed");
+  printf(1, "large DONTNEED: resident %d -> %d -> %d\n", before, touched, resident());
+  if(resident() > touched - LGPGSIZE / PGSIZE)
+    fail("MADV_DONTNEED kept a large page");
+  if(heap[0] != 0 || heap[LGPGSIZE - PGSIZE] != 0 || heap[LGPGSIZE] != 0)
+    fail("dropped large page did not read as zero");
+  if(heap[LGPGSIZE + PGSIZE] != 5)
+    fail("MADV_DONTNEED zeroed past its range");
+  // Shrinking into a large page and growing again zero-fills.
+  heap[LGPGSIZE + 3*PGSIZE] = 7;
+  if(sbrk(-(LGPGSIZE - 2*PGSIZE)) == (char*)-1 ||
+     sbrk(LGPGSIZE - 2*PGSIZE) == (char*)-1)
+    fail("sbrk in a large page failed");
+  if(heap[LGPGSIZE + PGSIZE] != 5 || heap[LGPGSIZE + 3*PGSIZE] != 0)
+    fail("regrown large page did not read as zero");
+  largepages(0);
+  sbrk(-2 * LGPGSIZE);
+
+  printf(1, "madvtest ok\n");
+  exit();
+}
@@ -30,6 +30,11 @@ main(void)
   tvinit();        // trap vectors
   binit();         // buffer cache
   fileinit();      // file table
+  icacheinit();    // inode cache
+  pcacheinit();    // file page cache
+  pipeinit();      // pipe cache
+  shminit();       // shared memory segments
+  swapinit();      // swap space and reverse map
   ideinit();       // disk 
   startothers();   // start other processors
   //这个参数传递没看懂
@@ -0,0 +1,10 @@
+#define PROT_READ   0x1
+#define PROT_WRITE  0x2
+
+#define MAP_SHARED  0x01
+#define MAP_PRIVATE 0x02
+
+#define MADV_NORMAL     0  // no special treatment
+#define MADV_SEQUENTIAL 2  // read ahead on page faults
+#define MADV_WILLNEED   3  // read the pages in now
+#define MADV_DONTNEED   4  // free the pages now
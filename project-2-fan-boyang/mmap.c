@@ -0,0 +1,357 @@
+// File mappings made by mmap(), attached shared memory, and
+// madvise().
+//
+// A mapping only records the file, offset and protection in
+// the process's vma table. Pages are mapped from the file page
+// cache (pcache.c) the first time they are touched. Shared
+// mappings map the cached page itself, writable if asked for,
+// so every process mapping the file sees the same bytes, and
+// dirty pages are written back through the log when they are
+// unmapped. Private mappings map the cached page copy-on-write.
+// Segments attached by shmat() (shm.c) use the same vma table,
+// with every page mapped up front.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "stat.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "mman.h"
+#include "vmstat.h"
+
+// Return the mapping of p that covers va, if any.
+struct vma*
+findvma(struct proc *p, uint va)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->start && va >= v->start && va < v->end)
+      return v;
+  return 0;
+}
+
+// Find room for len bytes of mappings, at the lowest address
+// at or above MMAPBASE. Returns 0 if there is none.
+static uint
+mmaprange(struct proc *p, uint len)
+{
+  struct vma *v;
+  uint start;
+  int moved;
+
+  start = MMAPBASE;
+  do {
+    moved = 0;
+    for(v = p->vma; v < &p->vma[NVMA]; v++){
+      if(v->start && v->start < start + len && start < v->end){
+        start = v->end;
+        moved = 1;
+      }
+    }
+  } while(moved);
+  if(len > KERNBASE - start)
+    return 0;
+  return start;
+}
+
+// Reserve a free vma slot of p and len bytes of address space
+// for it. Returns 0 if either has run out.
+struct vma*
+vmaalloc(struct proc *p, uint len)
+{
+  struct vma *v;
+
+  len = PGROUNDUP(len);
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->start == 0){
+      if((v->start = mmaprange(p, len)) == 0)
+        return 0;
+      v->end = v->start + len;
+      v->f = 0;
+      v->shm = 0;
+      v->advice = MADV_NORMAL;
+      return v;
+    }
+  }
+  return 0;
+}
+
+// Map len bytes of f, starting at file offset off, into the
+// current process. Returns the address of the mapping, or -1.
+int
+mmap(struct file *f, uint len, int prot, int flags, uint off)
+{
+  struct vma *v;
+
+  if(f->type != FD_INODE || f->ip->type != T_FILE)
+    return -1;
+  if(len == 0 || len > KERNBASE - MMAPBASE || off % PGSIZE != 0)
+    return -1;
+  if(flags != MAP_SHARED && flags != MAP_PRIVATE)
+    return -1;
+  if((prot & ~(PROT_READ|PROT_WRITE)) != 0 || !f->readable)
+    return -1;
+  if(flags == MAP_SHARED && (prot & PROT_WRITE) && !f->writable)
+    return -1;
+
+  if((v = vmaalloc(myproc(), len)) == 0)
+    return -1;
+  v->prot = prot;
+  v->flags = flags;
+  v->f = filedup(f);
+  v->off = off;
+  return v->start;
+}
+
+// Map the page of p's mapping v that covers va. Takes the page
+// from the file page cache, which may sleep, so the caller
+// must not hold any locks.
+int
+mmapfault(struct proc *p, uint va)
+{
+  struct vma *v;
+  struct inode *ip;
+  char *mem;
+  int perm;
+
+  // Shared memory segments are mapped in full by shmat().
+  if((v = findvma(p, va)) == 0 || v->f == 0)
+    return -1;
+  if(holdinglocks())
+    panic("mmapfault: locks held");
+  va = PGROUNDDOWN(va);
+  ip = v->f->ip;
+  ilock(ip);
+  mem = pcache_get(ip, v->off + (va - v->start), v->flags == MAP_SHARED);
+  iunlock(ip);
+  if(mem == 0)
+    return -1;
+
+  perm = PTE_U;
+  if(v->prot & PROT_WRITE)
+    perm |= (v->flags == MAP_SHARED) ? PTE_W : PTE_COW;
+  if(mappages(p->pgdir, (char*)va, PGSIZE, V2P(mem), perm) < 0){
+    kfree(mem);
+    return -1;
+  }
+  vmcount(VM_FILEFAULT, 1);
+  return 0;
+}
+
+// Write the shared page mem, mapped at va, back to its file.
+// Only the part inside the file is written; mappings cannot
+// make a file grow. Writes a few blocks per transaction, as
+// filewrite() does.
+static void
+writeback(struct vma *v, uint va, char *mem)
+{
+  struct inode *ip = v->f->ip;
+  uint off, i, n, max;
+
+  max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+  off = v->off + (va - v->start);
+  for(i = 0; i < PGSIZE; i += max){
+    n = PGSIZE - i;
+    if(n > max)
+      n = max;
+    begin_op();
+    ilock(ip);
+    if(off + i < ip->size){
+      if(off + i + n > ip->size)
+        n = ip->size - (off + i);
+      writei(ip, mem + i, off + i, n);
+    }
+    iunlock(ip);
+    end_op();
+  }
+}
+
+// Unmap the page at va of pgdir, whose PTE is pte. If it
+// belongs to a shared file mapping v and is dirty, write it
+// back first. Private copies made by copy-on-write faults, and
+// anonymous pages, may have been swapped out.
+static void
+pagedrop(struct proc *p, pde_t *pgdir, struct vma *v, uint va, pte_t *pte)
+{
+  char *mem;
+
+  acquire(&vmlock);
+  if(*pte & PTE_SWAP){
+    swapfree(*pte);
+    *pte = 0;
+  } else if(*pte & PTE_P){
+    mem = P2V(PTE_ADDR(*pte));
+    if(v && v->f && v->flags == MAP_SHARED && (*pte & PTE_D)){
+      // Shared pages are never swapped, so the PTE stays put.
+      release(&vmlock);
+      writeback(v, va, mem);
+      acquire(&vmlock);
+    }
+    rmapdel(pgdir, va, V2P(mem));
+    *pte = 0;
+    if(pgdir == p->pgdir)
+      invlpg((void*)va);
+    kfree(mem);
+  }
+  release(&vmlock);
+}
+
+// Remove mapping v of p from page table pgdir, writing dirty
+// shared pages back first.
+static void
+vmaunmap(struct proc *p, pde_t *pgdir, struct vma *v)
+{
+  pte_t *pte;
+  uint a;
+
+  for(a = v->start; a < v->end; a += PGSIZE){
+    if((pte = walkpgdir(pgdir, (char*)a, 0)) == 0){
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+      continue;
+    }
+    pagedrop(p, pgdir, v, a, pte);
+  }
+  if(v->f)
+    fileclose(v->f);
+  else
+    shmput(v->shm);
+  v->start = v->end = 0;
+  v->f = 0;
+  v->shm = 0;
+}
+
+// Remove the mapping of the current process that starts at
+// addr. Only whole file mappings can be removed; shmdt()
+// detaches shared memory.
+int
+munmap(uint addr, uint len)
+{
+  struct proc *curproc = myproc();
+  struct vma *v;
+
+  if((v = findvma(curproc, addr)) == 0 || v->f == 0)
+    return -1;
+  if(v->start != addr || v->end != addr + PGROUNDUP(len))
+    return -1;
+  vmaunmap(curproc, curproc->pgdir, v);
+  return 0;
+}
+
+// Detach the shared memory segment of the current process
+// that is mapped at addr.
+int
+shmdt(uint addr)
+{
+  struct proc *curproc = myproc();
+  struct vma *v;
+
+  if((v = findvma(curproc, addr)) == 0 || v->shm == 0 || v->start != addr)
+    return -1;
+  vmaunmap(curproc, curproc->pgdir, v);
+  return 0;
+}
+
+// Remove every mapping of p from page table pgdir, which
+// exit() and exec() are about to throw away.
+void
+munmapall(struct proc *p, pde_t *pgdir)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->start)
+      vmaunmap(p, pgdir, v);
+}
+
+// Give np the mappings of p. copyuvm() has already copied
+// the pages that are present.
+void
+dupvmas(struct proc *p, struct proc *np)
+{
+  int i;
+
+  for(i = 0; i < NVMA; i++){
+    np->vma[i] = p->vma[i];
+    if(p->vma[i].f)
+      filedup(p->vma[i].f);
+    else if(p->vma[i].shm)
+      shmdup(p->vma[i].shm);
+  }
+}
+
+// Act on advice about how the current process will use the
+// pages of [addr, addr+len), which must lie below sz or in a
+// single mapping. MADV_DONTNEED frees them: anonymous memory
+// reads as zero when next touched, program and file pages are
+// read in again; a 4 MB large page is freed only if the range
+// covers all of it, and otherwise zeroed where it does.
+// MADV_WILLNEED reads in the pages that are swapped out or
+// still on disk. MADV_SEQUENTIAL makes page faults read ahead,
+// for the whole mapping if addr is in one; MADV_NORMAL undoes
+// that.
+int
+madvise(uint addr, uint len, int advice)
+{
+  struct proc *curproc = myproc();
+  struct vma *v;
+  pte_t *pte;
+  uint a;
+
+  if(addr % PGSIZE != 0 || addr < PGSIZE || addr + len < addr)
+    return -1;
+  if(addr + len <= curproc->sz)
+    v = 0;
+  else if((v = findvma(curproc, addr)) == 0 || addr + len > v->end)
+    return -1;
+
+  switch(advice){
+  case MADV_NORMAL:
+  case MADV_SEQUENTIAL:
+    if(v)
+      v->advice = advice;
+    else if(advice == MADV_SEQUENTIAL){
+      curproc->seqstart = addr;
+      curproc->seqend = addr + len;
+    } else if(addr < curproc->seqend && curproc->seqstart < addr + len)
+      curproc->seqstart = curproc->seqend = 0;
+    return 0;
+  case MADV_WILLNEED:
+    return uvmpagein(curproc, addr, len, 0);
+  case MADV_DONTNEED:
+    // Shared memory pages are only mapped by shmat().
+    if(v && v->shm)
+      return -1;
+    for(a = addr; a < addr + len; a += PGSIZE){
+      if((pte = walkpgdir(curproc->pgdir, (char*)a, 0)) == 0){
+        uvmdroplarge(curproc, a, addr, addr + len);
+        a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+        continue;
+      }
+      // Leave the stack guard page alone.
+      if((*pte & (PTE_P|PTE_U)) == PTE_P)
+        continue;
+      pagedrop(curproc, curproc->pgdir, v, a, pte);
+    }
+    return 0;
+  }
+  return -1;
+}
+
+// Should a page fault at va in p read ahead?
+int
+readahead(struct proc *p, uint va)
+{
+  struct vma *v;
+
+  if(va < p->sz)
+    return va >= p->seqstart && va < p->seqend;
+  return (v = findvma(p, va)) != 0 && v->advice == MADV_SEQUENTIAL;
+}
@@ -0,0 +1,126 @@
+// mmap()/munmap() test.
+// Maps a file shared and private, checks that the mapping
+// shows the file contents, that writes through a shared
+// mapping reach the file and other processes while private
+// ones do not, that write() shows up in a shared mapping, and
+// that read() sees stores through one while it is mapped.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "mman.h"
+
+#define FSIZE  (3*4096 + 100)   // ends partway through a page
+
+char buf[FSIZE];
+
+void
+fail(char *what)
+{
+  printf(1, "mmaptest: %s failed\n", what);
+  unlink("mmapfile");
+  exit();
+}
+
+void
+makefile(void)
+{
+  int fd, i;
+
+  for(i = 0; i < FSIZE; i++)
+    buf[i] = 'a' + i % 23;
+  fd = open("mmapfile", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, buf, FSIZE) != FSIZE)
+    fail("create");
+  close(fd);
+}
+
+// Check that the file holds buf, changed to c at offset off.
+void
+checkfile(int off, char c)
+{
+  char b[FSIZE];
+  int fd, i;
+
+  fd = open("mmapfile", O_RDONLY);
+  if(fd < 0 || read(fd, b, FSIZE) != FSIZE)
+    fail("read back");
+  close(fd);
+  for(i = 0; i < FSIZE; i++)
+    if(b[i] != (i == off ? c : buf[i]))
+      fail("file contents");
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *p, *q;
+  int fd, i, pid;
+
+  makefile();
+
+  // Private mapping: reads the file, writes stay private.
+  fd = open("mmapfile", O_RDONLY);
+  if(fd < 0)
+    fail("open");
+  p = mmap(0, FSIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(p == (char*)-1)
+    fail("mmap private");
+  close(fd);
+  for(i = 0; i < FSIZE; i++)
+    if(p[i] != buf[i])
+      fail("private contents");
+  if(p[FSIZE] != 0 || p[4*4096 - 1] != 0)
+    fail("zero fill past end of file");
+  p[0] = 'X';
+  if(munmap(p, FSIZE) < 0)
+    fail("munmap private");
+  checkfile(-1, 0);
+  printf(1, "private mapping ok\n");
+
+  // Shared mapping: writes reach the file and a forked child.
+  fd = open("mmapfile", O_RDWR);
+  if(fd < 0)
+    fail("open");
+  p = mmap(0, FSIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == (char*)-1)
+    fail("mmap shared");
+  pid = fork();
+  if(pid < 0)
+    fail("fork");
+  if(pid == 0){
+    p[5000] = 'Y';
+    exit();
+  }
+  wait();
+  if(p[5000] != 'Y')
+    fail("shared write from child");
+
+  // write() must show up in the mapping.
+  q = "Z";
+  if(write(fd, q, 1) != 1)
+    fail("write");
+  if(p[0] != 'Z')
+    fail("write through to mapping");
+  buf[0] = 'Z';
+  close(fd);
+
+  // The mapping can be handed to a system call.
+  if((fd = open("mmapcopy", O_CREATE|O_RDWR)) < 0 || write(fd, p, FSIZE) != FSIZE)
+    fail("write from mapping");
+  close(fd);
+  unlink("mmapcopy");
+
+  // read() sees stores through the mapping before munmap().
+  checkfile(5000, 'Y');
+
+  if(munmap(p, FSIZE) < 0)
+    fail("munmap shared");
+  checkfile(5000, 'Y');
+  printf(1, "shared mapping ok\n");
+
+  unlink("mmapfile");
+  printf(1, "mmaptest ok\n");
+  exit();
+}
@@ -94,8 +94,16 @@ struct segdesc {
 #define PTE_P           0x001   // Present
 #define PTE_W           0x002   // Writeable
 #define PTE_U           0x004   // User
+#define PTE_A           0x020   // Accessed
+#define PTE_D           0x040   // Dirty
 #define PTE_PS          0x080   // Page Size
 #define PTE_COW         0x100   // flag for COW page
+#define PTE_SWAP        0x200   // not present, in the swap slot in the address bits
+
+// Page fault error code bits.
+#define FEC_PR          0x1     // Fault on a present page
+#define FEC_WR          0x2     // Fault was a write
+#define FEC_U           0x4     // Fault happened in user mode
 // Address in page table or page directory entry
 #define PTE_ADDR(pte)   ((uint)(pte) & ~0xFFF)
 #define PTE_FLAGS(pte)  ((uint)(pte) &  0xFFF)
@@ -2,13 +2,19 @@
 #define KSTACKSIZE 4096  // size of per-process kernel stack
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
-#define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
+#define NSEG          4  // max loadable ELF segments per program
+#define USTACKPAGES 256  // max user stack pages, allocated as it grows
+#define NVMA          8  // mmap() mappings per process
+#define NSHM         16  // shared memory segments
+#define SHMMAXPAGES  64  // max pages in a shared memory segment
+#define NPCACHE     256  // pages of program text kept cached
+#define MAXPGREF 0x7fff  // page or swap slot references fork() may share
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       1000  // size of file system in blocks
+#define SWAPBLOCKS  16384  // size of swap area after the file system, in blocks
 
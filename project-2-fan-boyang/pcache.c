@@ -0,0 +1,288 @@
+// Page cache for file contents.
+//
+// Holds whole pages of files, keyed by device, inode number
+// and file offset. Program text and mmap() mappings both map
+// these pages straight into user address spaces, so every
+// exec of the same program, and every process mapping the same
+// file, shares one physical copy instead of reading its own.
+//
+// Pages used for program text or private mappings are mapped
+// copy-on-write, so a process that writes to one gets its own
+// copy through the usual COW fault path. A page that has ever
+// been handed out for a shared mapping is marked shared: it
+// is mapped writable, holds the newest contents of that part
+// of the file, and is written back through the log when it
+// is unmapped. Until then readi() calls pcache_read() to copy
+// those contents over what it read from disk, so read() sees
+// stores through a live shared mapping; there is no msync().
+//
+// The cache owns one reference to each page it holds. A page
+// stays cached after the last process using it is gone, until
+// the slot is needed for another page, kalloc() runs out of
+// memory and calls pcache_reclaim(), or the file changes.
+// writei() calls pcache_write(): shared pages are updated in
+// place, so mappings see the write; other pages are dropped,
+// and processes that already mapped them from a private
+// mapping keep the old contents. Program text never changes
+// under a running process, which reads it from the executable
+// on demand for as long as it runs: writei() refuses to write
+// to a file that is being executed (see idenywrite()).
+//
+// Entries for one inode hash to the same chain, so that
+// pcache_write() only walks a short chain. Callers hold the
+// inode's sleep lock, which keeps reads and writes of a file
+// from racing. pcache.lock is taken before kalloc's locks.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+
+#define NPHASH 31
+#define PHASH(dev, inum) (((dev)*31+(inum))%NPHASH)
+
+struct cpage {
+  uint dev;
+  uint inum;
+  uint off;             // file offset of the page
+  char *mem;            // cached page, 0 if the slot is free
+  int shared;           // handed out for a shared mapping
+  struct cpage *next;   // hash chain
+};
+
+static struct {
+  struct spinlock lock;
+  struct cpage page[NPCACHE];
+  struct cpage *hash[NPHASH];
+  int hand;             // next slot to consider for eviction
+} pcache;
+
+void
+pcacheinit(void)
+{
+  initlock(&pcache.lock, "pcache");
+}
+
+// Unlink c from its hash chain, drop the cache's reference
+// to its page and free the slot.
+static void
+pcache_remove(struct cpage *c)
+{
+  struct cpage **pp;
+
+  for(pp = &pcache.hash[PHASH(c->dev, c->inum)]; *pp != c; pp = &(*pp)->next)
+    ;
+  *pp = c->next;
+  kfree(c->mem);
+  c->mem = 0;
+  c->shared = 0;
+  c->next = 0;
+}
+
+// Pick a slot for a new page, evicting one if the cache is
+// full. Prefers pages no process has mapped, and never evicts
+// a shared page that is still mapped, since it may hold
+// changes not yet written back. Returns 0 if every slot is
+// such a page.
+static struct cpage*
+pcache_slot(void)
+{
+  struct cpage *c;
+  int i, ref;
+
+  for(i = 0; i < 2*NPCACHE; i++){
+    c = &pcache.page[pcache.hand];
+    pcache.hand = (pcache.hand + 1) % NPCACHE;
+    if(c->mem == 0)
+      return c;
+    ref = get_ref_count(V2P(c->mem));
+    if(ref == 1 || (i >= NPCACHE && !c->shared)){
+      pcache_remove(c);
+      return c;
+    }
+  }
+  return 0;
+}
+
+// Return the page of ip at file offset off, reading it in on
+// a miss; the part past the end of the file reads as zeros.
+// The caller gets its own reference to the page. Unless shared
+// is set, it must map the page read-only. Returns 0 if off is
+// past the end of the file or the page cannot be read.
+// Caller must hold ip->lock.
+char*
+pcache_get(struct inode *ip, uint off, int shared)
+{
+  struct cpage *c;
+  char *mem;
+  uint n;
+
+  acquire(&pcache.lock);
+  for(c = pcache.hash[PHASH(ip->dev, ip->inum)]; c; c = c->next){
+    if(c->dev == ip->dev && c->inum == ip->inum && c->off == off){
+      mem = c->mem;
+      c->shared |= shared;
+      inc_ref_count(V2P(mem));
+      release(&pcache.lock);
+      return mem;
+    }
+  }
+  release(&pcache.lock);
+
+  if(off >= ip->size)
+    return 0;
+  n = ip->size - off;
+  if(n > PGSIZE)
+    n = PGSIZE;
+  if((mem = (n < PGSIZE) ? kalloc_zeroed() : kalloc()) == 0)
+    return 0;
+  if(readi(ip, mem, off, n) != n){
+    kfree(mem);
+    return 0;
+  }
+
+  // ip->lock keeps anyone else from adding this page meanwhile.
+  acquire(&pcache.lock);
+  if((c = pcache_slot()) == 0){
+    release(&pcache.lock);
+    if(shared){
+      // A shared mapping must see the cached copy.
+      kfree(mem);
+      return 0;
+    }
+    return mem;
+  }
+  c->dev = ip->dev;
+  c->inum = ip->inum;
+  c->off = off;
+  c->mem = mem;
+  c->shared = shared;
+  c->next = pcache.hash[PHASH(ip->dev, ip->inum)];
+  pcache.hash[PHASH(ip->dev, ip->inum)] = c;
+  inc_ref_count(V2P(mem));
+  release(&pcache.lock);
+  return mem;
+}
+
+// Bring the cached pages of ip up to date with a write of n
+// bytes from src at file offset off. src must already be
+// mapped, since this copies from it holding a spinlock.
+// Caller must hold ip->lock.
+void
+pcache_write(struct inode *ip, char *src, uint off, uint n)
+{
+  struct cpage *c, *next;
+  uint start, end;
+
+  acquire(&pcache.lock);
+  for(c = pcache.hash[PHASH(ip->dev, ip->inum)]; c; c = next){
+    next = c->next;
+    if(c->dev != ip->dev || c->inum != ip->inum)
+      continue;
+    if(c->off >= off + n || c->off + PGSIZE <= off)
+      continue;
+    if(!c->shared){
+      pcache_remove(c);
+      continue;
+    }
+    start = c->off > off ? c->off : off;
+    end = c->off + PGSIZE < off + n ? c->off + PGSIZE : off + n;
+    // Writing back a mapped page copies it onto itself.
+    if(c->mem + (start - c->off) != src + (start - off))
+      memmove(c->mem + (start - c->off), src + (start - off), end - start);
+  }
+  release(&pcache.lock);
+}
+
+// Copy the parts of the n bytes at file offset off that shared
+// pages of ip hold over dst, which readi() filled from disk.
+// Each page is copied holding a reference instead of
+// pcache.lock, since writing to dst may fault.
+// Caller must hold ip->lock.
+void
+pcache_read(struct inode *ip, char *dst, uint off, uint n)
+{
+  struct cpage *c;
+  char *mem;
+  uint pg, start, end;
+
+  for(pg = PGROUNDDOWN(off); pg < off + n; pg += PGSIZE){
+    mem = 0;
+    acquire(&pcache.lock);
+    for(c = pcache.hash[PHASH(ip->dev, ip->inum)]; c; c = c->next){
+      if(c->dev == ip->dev && c->inum == ip->inum && c->off == pg){
+        if(c->shared){
+          mem = c->mem;
+          inc_ref_count(V2P(mem));
+        }
+        break;
+      }
+    }
+    release(&pcache.lock);
+    if(mem == 0)
+      continue;
+    start = pg > off ? pg : off;
+    end = pg + PGSIZE < off + n ? pg + PGSIZE : off + n;
+    memmove(dst + (start - off), mem + (start - pg), end - start);
+    kfree(mem);
+  }
+}
+
+// Drop every cached page of ip, because the file is being
+// truncated. Processes that already mapped a page keep it.
+// Caller must hold ip->lock.
+void
+pcache_invalidate(struct inode *ip)
+{
+  struct cpage *c, *next;
+
+  acquire(&pcache.lock);
+  for(c = pcache.hash[PHASH(ip->dev, ip->inum)]; c; c = next){
+    next = c->next;
+    if(c->dev == ip->dev && c->inum == ip->inum)
+      pcache_remove(c);
+  }
+  release(&pcache.lock);
+}
+
+// Give back the cached pages that no process has mapped.
+// Called by kalloc() when it runs out of memory.
+// Returns the number of pages freed.
+int
+pcache_reclaim(void)
+{
+  struct cpage *c;
+  int n;
+
+  acquire(&pcache.lock);
+  n = 0;
+  for(c = pcache.page; c < &pcache.page[NPCACHE]; c++){
+    if(c->mem && get_ref_count(V2P(c->mem)) == 1){
+      pcache_remove(c);
+      n++;
+    }
+  }
+  release(&pcache.lock);
+  return n;
+}
+
+// Count the pages in the cache.
+int
+pcache_count(void)
+{
+  struct cpage *c;
+  int n;
+
+  acquire(&pcache.lock);
+  n = 0;
+  for(c = pcache.page; c < &pcache.page[NPCACHE]; c++)
+    if(c->mem)
+      n++;
+  release(&pcache.lock);
+  return n;
+}
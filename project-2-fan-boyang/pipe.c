@@ -7,6 +7,8 @@
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "slab.h"
+#include "vmstat.h"
 
 #define PIPESIZE 512
 
@@ -19,6 +21,15 @@ struct pipe {
   int writeopen;  // write fd is still open
 };
 
+// Several pipes share each page.
+static struct kmem_cache pipecache;
+
+void
+pipeinit(void)
+{
+  kmem_cache_init(&pipecache, "pipe", sizeof(struct pipe));
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -28,8 +39,9 @@ pipealloc(struct file **f0, struct file **f1)
   *f0 = *f1 = 0;
   if((*f0 = filealloc()) == 0 || (*f1 = filealloc()) == 0)
     goto bad;
-  if((p = (struct pipe*)kalloc()) == 0)
+  if((p = kmem_cache_alloc(&pipecache)) == 0)
     goto bad;
+  vmcount(VM_PIPES, 1);
   p->readopen = 1;
   p->writeopen = 1;
   p->nwrite = 0;
@@ -48,7 +60,7 @@ pipealloc(struct file **f0, struct file **f1)
 //PAGEBREAK: 20
  bad:
   if(p)
-    kfree((char*)p);
+    kmem_cache_free(&pipecache, p);
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -69,7 +81,8 @@ pipeclose(struct pipe *p, int writable)
   }
   if(p->readopen == 0 && p->writeopen == 0){
     release(&p->lock);
-    kfree((char*)p);
+    kmem_cache_free(&pipecache, p);
+    vmcount(VM_PIPES, -1);
   } else
     release(&p->lock);
 }
@@ -88,6 +88,13 @@ allocproc(void)
 found:
   p->state = EMBRYO;
   p->pid = nextpid++;
+  p->nzfod = 0;
+  p->npagein = 0;
+  p->nshared = 0;
+  p->nlarge = 0;
+  p->largepages = 0;
+  p->seqstart = p->seqend = 0;
+  p->pinstart = p->pinend = 0;
 
   release(&ptable.lock);
 
@@ -154,6 +161,8 @@ userinit(void)
 }
 
 // Grow current process's memory by n bytes.
+// Growing only reserves address space; page_fault_handler()
+// allocates a zeroed page the first time each one is touched.
 // Return 0 on success, -1 on failure.
 int
 growproc(int n)
@@ -163,8 +172,10 @@ growproc(int n)
 
   sz = curproc->sz;
   if(n > 0){
-    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    if(sz + n < sz || sz + n > MMAPBASE)
       return -1;
+    curproc->sz = sz + n;
+    return 0;
   } else if(n < 0){
     if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
       return -1;
@@ -190,7 +201,7 @@ fork(void)
   }
 
   // Copy process state from proc.
-  if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0){
+  if((np->pgdir = copyuvm(curproc)) == 0){
     kfree(np->kstack);
     np->kstack = 0;
     np->state = UNUSED;
@@ -208,6 +219,16 @@ fork(void)
     if(curproc->ofile[i])
       np->ofile[i] = filedup(curproc->ofile[i]);
   np->cwd = idup(curproc->cwd);
+  if(curproc->exe){
+    np->exe = idup(curproc->exe);
+    idenywrite(np->exe);
+  }
+  np->nseg = curproc->nseg;
+  np->largepages = curproc->largepages;
+  np->seqstart = curproc->seqstart;
+  np->seqend = curproc->seqend;
+  memmove(np->seg, curproc->seg, sizeof(np->seg));
+  dupvmas(curproc, np);
 
   safestrcpy(np->name, curproc->name, sizeof(curproc->name));
 
@@ -234,7 +255,8 @@ exit(void)
   if(curproc == initproc)
     panic("init exiting");
 
-  // Close all open files.
+  // Write back and drop file mappings, then close all open files.
+  munmapall(curproc, curproc->pgdir);
   for(fd = 0; fd < NOFILE; fd++){
     if(curproc->ofile[fd]){
       fileclose(curproc->ofile[fd]);
@@ -242,10 +264,16 @@ exit(void)
     }
   }
 
+  if(curproc->exe)
+    iallowwrite(curproc->exe);
   begin_op();
   iput(curproc->cwd);
+  if(curproc->exe)
+    iput(curproc->exe);
   end_op();
   curproc->cwd = 0;
+  curproc->exe = 0;
+  curproc->nseg = 0;
 
   acquire(&ptable.lock);
 
@@ -275,6 +303,7 @@ wait(void)
   struct proc *p;
   int havekids, pid;
   struct proc *curproc = myproc();
+  pde_t *pgdir;
   
   acquire(&ptable.lock);
   for(;;){
@@ -289,13 +318,16 @@ wait(void)
         pid = p->pid;
         kfree(p->kstack);
         p->kstack = 0;
-        freevm(p->pgdir);
+        pgdir = p->pgdir;
+        p->pgdir = 0;
         p->pid = 0;
         p->parent = 0;
         p->name[0] = 0;
         p->killed = 0;
         p->state = UNUSED;
         release(&ptable.lock);
+        // freevm() takes vmlock, which comes before ptable.lock.
+        freevm(pgdir);
         return pid;
       }
     }
@@ -324,6 +356,7 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int ran;
   c->proc = 0;
   
   for(;;){
@@ -331,10 +364,12 @@ scheduler(void)
     sti();
 
     // Loop over process table looking for process to run.
+    ran = 0;
     acquire(&ptable.lock);
     for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
       if(p->state != RUNNABLE)
         continue;
+      ran = 1;
 
       // Switch to chosen process.  It is the process's job
       // to release ptable.lock and then reacquire it
@@ -352,6 +387,11 @@ scheduler(void)
     }
     release(&ptable.lock);
 
+    // Nothing to run: put the idle time to use.
+    if(!ran){
+      kzeroidle();
+      ksmidle();
+    }
   }
 }
 
@@ -407,6 +447,7 @@ forkret(void)
     first = 0;
     iinit(ROOTDEV);
     initlog(ROOTDEV);
+    swapon(ROOTDEV);
   }
 
   // Return to "caller", actually trapret (see allocproc).
@@ -532,3 +573,39 @@ procdump(void)
     cprintf("\n");
   }
 }
+
+// While the caller holds ptable.lock, no CPU can switch to
+// another address space. swapout() relies on this to know that
+// the PTEs it rewrites are not cached in another CPU's TLB.
+void
+ptablelock(void)
+{
+  acquire(&ptable.lock);
+}
+
+void
+ptableunlock(void)
+{
+  release(&ptable.lock);
+}
+
+// Can the page at va in page table pgdir be paged out now?
+// Only if pgdir belongs to a live process that is not running
+// on another CPU, and va is not in the user memory its current
+// system call is using. Caller must hold ptable.lock.
+int
+pageoutok(pde_t *pgdir, uint va)
+{
+  struct proc *p, *curproc = myproc();
+
+  if(!holding(&ptable.lock))
+    panic("pageoutok");
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->state == UNUSED || p->pgdir != pgdir)
+      continue;
+    if(p->state == ZOMBIE || (p->state == RUNNING && p != curproc))
+      return 0;
+    return va < p->pinstart || va >= p->pinend;
+  }
+  return 0;
+}
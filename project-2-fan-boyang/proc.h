@@ -34,6 +34,31 @@ struct context {
 
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// A file mapping made by mmap(), or a shared memory segment
+// attached by shmat(), somewhere between MMAPBASE and KERNBASE.
+// File pages come from the file page cache when they are first
+// touched.
+struct vma {
+  uint start;         // page-aligned; 0 if the slot is free
+  uint end;
+  int prot;           // PROT_READ, PROT_WRITE
+  int flags;          // MAP_SHARED or MAP_PRIVATE
+  struct file *f;     // mapped file, or
+  struct shm *shm;    // attached shared memory segment
+  uint off;           // file offset of start
+  int advice;         // MADV_NORMAL or MADV_SEQUENTIAL
+};
+
+// A loadable ELF segment of the running program. exec() only
+// records these; page_fault_handler() reads each page in from
+// the executable the first time it is touched.
+struct vmseg {
+  uint va;      // page-aligned start address
+  uint off;     // file offset of va
+  uint filesz;  // bytes backed by the file
+  uint memsz;   // bytes in memory; the rest is zero-filled
+};
+
 // Per-process state
 struct proc {
   uint sz;                     // Size of process memory (bytes)
@@ -49,10 +74,24 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  uint nzfod;                  // Demand-zero heap faults taken
+  uint npagein;                // Pages read in from the executable
+  uint nshared;                // Pages mapped from the text cache
+  uint nlarge;                 // 4 MB large pages mapped
+  int largepages;              // If non-zero, map heap with large pages
+  struct inode *exe;           // Executable backing seg[]
+  int nseg;                    // Number of entries in seg[]
+  struct vmseg seg[NSEG];      // Segments not yet read in
+  struct vma vma[NVMA];        // File mappings
+  uint seqstart;               // Range below sz advised
+  uint seqend;                 //   MADV_SEQUENTIAL
+  uint pinstart;               // User memory in use by the current
+  uint pinend;                 //   system call; kept out of swap
 };
 
 // Process memory is laid out contiguously, low addresses first:
 //   text
 //   original data and bss
-//   fixed-size stack
+//   guard page and stack, grown on demand up to USTACKPAGES
 //   expandable heap
+// followed, from MMAPBASE up, by any mmap() mappings.
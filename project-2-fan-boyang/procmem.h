@@ -0,0 +1,20 @@
+#ifndef _PROCMEM_H_
+#define _PROCMEM_H_
+
+// Memory use of the calling process, in pages. Heap grown by
+// sbrk() is reserved at once, and the program image is read
+// from the executable a page at a time; both only become
+// resident when first touched, and heap and bss that are only
+// read share a single zero page until they are written.
+struct procmem {
+  uint reserved;  // pages of address space below sz
+  uint resident;  // pages backed by physical memory
+  uint nzfod;     // demand-zero faults taken so far
+  uint npagein;   // pages read in from the executable so far
+  uint nshared;   // pages mapped from the shared text cache
+  uint nlarge;    // 4 MB large pages mapped so far
+  uint nzero;     // resident pages that map the shared zero page,
+                  // so take no memory of their own
+};
+
+#endif //_PROCMEM_H_
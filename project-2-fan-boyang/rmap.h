@@ -0,0 +1,7 @@
+// One PTE mapping an anonymous page. Every anonymous page
+// has a list of these; see swap.c.
+struct rmap {
+  pde_t *pgdir;
+  uint va;
+  struct rmap *next;
+};
@@ -0,0 +1,184 @@
+// Shared memory segments.
+//
+// shmget() creates a segment of zeroed pages under a key, or
+// finds the one that exists. shmat() maps all of a segment's
+// pages into the calling process, next to its file mappings,
+// and shmdt() removes them again. The segment holds one
+// kalloc() reference to each of its pages and every mapping
+// holds another, so a page is freed once the segment is gone
+// and no process maps it any more. A segment goes away when
+// its last attachment is detached, by shmdt() or exit();
+// fork() attaches the child as well. shmrm() removes a segment
+// that nothing has attached, or one whose creator is done with
+// it: the key is free again at once, and the pages go with the
+// last detach.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "mman.h"
+
+struct shm {
+  int key;
+  int npages;           // 0 if the slot is free
+  int nattach;          // vmas mapping the segment
+  int removed;          // shmrm() called, key no longer found
+  char *pages[SHMMAXPAGES];
+};
+
+static struct {
+  struct spinlock lock;
+  struct shm shm[NSHM];
+} shmtable;
+
+void
+shminit(void)
+{
+  initlock(&shmtable.lock, "shm");
+}
+
+// Return the segment with the given key, if any.
+// Caller must hold shmtable.lock.
+static struct shm*
+shmlookup(int key)
+{
+  struct shm *s;
+
+  for(s = shmtable.shm; s < &shmtable.shm[NSHM]; s++)
+    if(s->npages && !s->removed && s->key == key)
+      return s;
+  return 0;
+}
+
+// Free the pages of s and its slot.
+// Caller must hold shmtable.lock.
+static void
+shmfree(struct shm *s)
+{
+  int i;
+
+  for(i = 0; i < s->npages; i++)
+    kfree(s->pages[i]);
+  s->npages = 0;
+}
+
+// Create a segment of size bytes under key, unless there
+// already is one at least that big. Returns 0 either way, not
+// an identifier: the key names the segment, or -1.
+int
+shmget(int key, uint size)
+{
+  struct shm *s;
+  int i, n;
+
+  n = PGROUNDUP(size) / PGSIZE;
+  if(n <= 0 || n > SHMMAXPAGES)
+    return -1;
+
+  acquire(&shmtable.lock);
+  if((s = shmlookup(key)) != 0){
+    release(&shmtable.lock);
+    return s->npages >= n ? 0 : -1;
+  }
+  for(s = shmtable.shm; s < &shmtable.shm[NSHM]; s++)
+    if(s->npages == 0)
+      break;
+  if(s == &shmtable.shm[NSHM]){
+    release(&shmtable.lock);
+    return -1;
+  }
+  for(i = 0; i < n; i++){
+    if((s->pages[i] = kalloc_zeroed()) == 0){
+      while(--i >= 0)
+        kfree(s->pages[i]);
+      release(&shmtable.lock);
+      return -1;
+    }
+  }
+  s->key = key;
+  s->npages = n;
+  s->nattach = 0;
+  s->removed = 0;
+  release(&shmtable.lock);
+  return 0;
+}
+
+// Remove the segment with the given key, like IPC_RMID: it is
+// freed now if nothing maps it, or else when the last process
+// detaches. Either way shmget() can make a new one under key.
+int
+shmrm(int key)
+{
+  struct shm *s;
+
+  acquire(&shmtable.lock);
+  if((s = shmlookup(key)) == 0){
+    release(&shmtable.lock);
+    return -1;
+  }
+  s->removed = 1;
+  if(s->nattach == 0)
+    shmfree(s);
+  release(&shmtable.lock);
+  return 0;
+}
+
+// Map the segment with the given key into the current process.
+// Returns its address, or -1.
+int
+shmat(int key)
+{
+  struct proc *curproc = myproc();
+  struct shm *s;
+  struct vma *v;
+  int i;
+
+  acquire(&shmtable.lock);
+  if((s = shmlookup(key)) == 0){
+    release(&shmtable.lock);
+    return -1;
+  }
+  s->nattach++;
+  release(&shmtable.lock);
+
+  if((v = vmaalloc(curproc, s->npages * PGSIZE)) == 0){
+    shmput(s);
+    return -1;
+  }
+  v->prot = PROT_READ|PROT_WRITE;
+  v->flags = MAP_SHARED;
+  v->shm = s;
+  v->off = 0;
+  for(i = 0; i < s->npages; i++){
+    if(mappages(curproc->pgdir, (char*)v->start + i*PGSIZE, PGSIZE,
+                V2P(s->pages[i]), PTE_W|PTE_U) < 0){
+      shmdt(v->start);
+      return -1;
+    }
+    inc_ref_count(V2P(s->pages[i]));
+  }
+  return v->start;
+}
+
+// Another vma maps s.
+void
+shmdup(struct shm *s)
+{
+  acquire(&shmtable.lock);
+  s->nattach++;
+  release(&shmtable.lock);
+}
+
+// A vma mapping s went away. Free the segment with the last one.
+void
+shmput(struct shm *s)
+{
+  acquire(&shmtable.lock);
+  if(--s->nattach == 0)
+    shmfree(s);
+  release(&shmtable.lock);
+}
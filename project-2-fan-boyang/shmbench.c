@@ -0,0 +1,144 @@
+// Shared memory vs. pipe throughput.
+// A producer process hands TOTAL bytes to a consumer, which
+// checksums them, first through a pipe and then through a
+// shared memory segment used as two alternating halves. For
+// shared memory only a one-byte token per half goes through
+// a pipe in each direction; the data itself is never copied.
+// Word k of the stream holds k in both cases, so the two
+// checksums must agree.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define TOTAL   (8*1024*1024)
+#define SHMSIZE (64*4096)
+#define HALF    (SHMSIZE/2)
+#define CHUNK   4096
+#define KEY     0x5348
+
+char buf[CHUNK];
+
+uint
+checksum(uint *p, int n)
+{
+  uint sum;
+  int i;
+
+  sum = 0;
+  for(i = 0; i < n/4; i++)
+    sum += p[i];
+  return sum;
+}
+
+// Fill n bytes that start at byte off of the stream.
+void
+fill(uint *p, int n, uint off)
+{
+  int i;
+
+  for(i = 0; i < n/4; i++)
+    p[i] = off/4 + i;
+}
+
+void
+report(char *what, int t)
+{
+  if(t == 0)
+    t = 1;
+  printf(1, "%s: %d KB in %d ticks, %d KB/sec\n",
+         what, TOTAL/1024, t, TOTAL/1024 * 100 / t);
+}
+
+uint
+pipebench(void)
+{
+  int fds[2], n, got, t;
+  uint sum;
+
+  if(pipe(fds) < 0){
+    printf(1, "shmbench: pipe failed\n");
+    exit();
+  }
+  t = uptime();
+  if(fork() == 0){
+    close(fds[0]);
+    for(n = 0; n < TOTAL; n += CHUNK){
+      fill((uint*)buf, CHUNK, n);
+      if(write(fds[1], buf, CHUNK) != CHUNK){
+        printf(1, "shmbench: pipe write failed\n");
+        exit();
+      }
+    }
+    exit();
+  }
+  close(fds[1]);
+  sum = 0;
+  for(got = 0; got < TOTAL; got += n){
+    if((n = read(fds[0], buf, CHUNK)) <= 0)
+      break;
+    sum += checksum((uint*)buf, n);
+  }
+  close(fds[0]);
+  wait();
+  report("pipe", uptime() - t);
+  if(got != TOTAL)
+    printf(1, "shmbench: pipe lost data\n");
+  return sum;
+}
+
+uint
+shmbench(void)
+{
+  int full[2], empty[2], n, t;
+  char *shm, c;
+  uint sum;
+
+  if(shmget(KEY, SHMSIZE) < 0 || (shm = shmat(KEY)) == (char*)-1){
+    printf(1, "shmbench: shmget/shmat failed\n");
+    exit();
+  }
+  if(pipe(full) < 0 || pipe(empty) < 0){
+    printf(1, "shmbench: pipe failed\n");
+    exit();
+  }
+  t = uptime();
+  if(fork() == 0){
+    // Producer: fill a half, then say so.
+    close(full[0]);
+    close(empty[1]);
+    for(n = 0; n < TOTAL; n += HALF){
+      if(n >= 2*HALF && read(empty[0], &c, 1) != 1)
+        exit();
+      fill((uint*)(shm + n % SHMSIZE), HALF, n);
+      write(full[1], &c, 1);
+    }
+    exit();
+  }
+  // Consumer: wait for a half, use it in place, give it back.
+  close(full[1]);
+  close(empty[0]);
+  sum = 0;
+  for(n = 0; n < TOTAL; n += HALF){
+    if(read(full[0], &c, 1) != 1){
+      printf(1, "shmbench: producer died\n");
+      break;
+    }
+    sum += checksum((uint*)(shm + n % SHMSIZE), HALF);
+    write(empty[1], &c, 1);
+  }
+  close(full[0]);
+  close(empty[1]);
+  wait();
+  report("shm", uptime() - t);
+  shmdt(shm);
+  return sum;
+}
+
+int
+main(int argc, char *argv[])
+{
+  if(pipebench() != shmbench())
+    printf(1, "shmbench: checksums differ\n");
+  exit();
+}
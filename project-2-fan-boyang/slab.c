@@ -0,0 +1,178 @@
+// Slab allocator for small kernel objects.
+//
+// A kmem_cache hands out objects of a single size, carved out
+// of whole pages from kalloc() ("slabs"). Each slab starts with
+// a struct slab header, so the slab that owns an object is found
+// by rounding the object's address down to a page boundary.
+// A slab is given back to kalloc() as soon as all of its
+// objects are free.
+//
+// In front of the slabs, each CPU has a magazine of recently
+// freed objects, so most allocations and frees take no lock.
+// A magazine is refilled from, or flushed to, the slabs half
+// a magazine at a time.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "slab.h"
+
+struct slab {
+  struct slab *next;
+  struct slab *prev;
+  struct kmem_cache *cache;
+  void *freelist;  // free objects in this slab, linked through their first word
+  uint inuse;      // objects handed out to the cache's magazines or callers
+};
+
+#define SLABHDR  ((sizeof(struct slab) + 7) & ~7)
+
+void
+kmem_cache_init(struct kmem_cache *c, char *name, uint size)
+{
+  memset(c, 0, sizeof(*c));
+  c->name = name;
+  if(size < sizeof(void*))
+    size = sizeof(void*);
+  c->size = (size + 3) & ~3;
+  c->perslab = (PGSIZE - SLABHDR) / c->size;
+  if(c->perslab == 0)
+    panic("kmem_cache_init: object too large");
+  initlock(&c->lock, name);
+}
+
+static void
+slab_unlink(struct slab **list, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    *list = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+}
+
+static void
+slab_push(struct slab **list, struct slab *s)
+{
+  s->prev = 0;
+  s->next = *list;
+  if(s->next)
+    s->next->prev = s;
+  *list = s;
+}
+
+// Get a fresh page from kalloc() and carve it into objects.
+// Caller must hold c->lock.
+static struct slab*
+slab_grow(struct kmem_cache *c)
+{
+  struct slab *s;
+  char *obj;
+  uint i;
+
+  if((s = (struct slab*)kalloc()) == 0)
+    return 0;
+  s->cache = c;
+  s->inuse = 0;
+  s->freelist = 0;
+  obj = (char*)s + SLABHDR + (c->perslab - 1) * c->size;
+  for(i = 0; i < c->perslab; i++, obj -= c->size){
+    *(void**)obj = s->freelist;
+    s->freelist = obj;
+  }
+  slab_push(&c->partial, s);
+  c->nslab++;
+  return s;
+}
+
+// Move up to MAGSIZE/2 objects from the slabs into magazine m.
+static void
+slab_refill(struct kmem_cache *c, struct magazine *m)
+{
+  struct slab *s;
+  void *obj;
+
+  acquire(&c->lock);
+  while(m->n < MAGSIZE/2){
+    if((s = c->partial) == 0 && (s = slab_grow(c)) == 0)
+      break;
+    obj = s->freelist;
+    s->freelist = *(void**)obj;
+    s->inuse++;
+    if(s->freelist == 0){
+      slab_unlink(&c->partial, s);
+      slab_push(&c->full, s);
+    }
+    m->obj[m->n++] = obj;
+  }
+  release(&c->lock);
+}
+
+// Return the older half of magazine m to the slabs, freeing
+// any slab that becomes completely unused.
+static void
+slab_flush(struct kmem_cache *c, struct magazine *m)
+{
+  struct slab *s;
+  void *obj;
+  int i;
+
+  acquire(&c->lock);
+  for(i = 0; i < MAGSIZE/2; i++){
+    obj = m->obj[i];
+    s = (struct slab*)PGROUNDDOWN((uint)obj);
+    if(s->cache != c)
+      panic("kmem_cache_free: wrong cache");
+    if(s->freelist == 0){
+      slab_unlink(&c->full, s);
+      slab_push(&c->partial, s);
+    }
+    *(void**)obj = s->freelist;
+    s->freelist = obj;
+    if(--s->inuse == 0){
+      slab_unlink(&c->partial, s);
+      c->nslab--;
+      kfree((char*)s);
+    }
+  }
+  release(&c->lock);
+  memmove(m->obj, m->obj + MAGSIZE/2, (m->n - MAGSIZE/2) * sizeof(void*));
+  m->n -= MAGSIZE/2;
+}
+
+// Allocate one object from cache c.
+// Returns 0 if memory is exhausted.
+void*
+kmem_cache_alloc(struct kmem_cache *c)
+{
+  struct magazine *m;
+  void *obj;
+
+  pushcli();
+  m = &c->mag[cpuid()];
+  if(m->n == 0)
+    slab_refill(c, m);
+  obj = 0;
+  if(m->n > 0)
+    obj = m->obj[--m->n];
+  popcli();
+  return obj;
+}
+
+// Give obj back to cache c.
+void
+kmem_cache_free(struct kmem_cache *c, void *obj)
+{
+  struct magazine *m;
+
+  pushcli();
+  m = &c->mag[cpuid()];
+  if(m->n == MAGSIZE)
+    slab_flush(c, m);
+  m->obj[m->n++] = obj;
+  popcli();
+}
@@ -0,0 +1,22 @@
+// Object caches for small, fixed-size kernel objects.
+// Requires param.h and spinlock.h.
+
+#define MAGSIZE 16  // objects held by each CPU's magazine
+
+// Recently freed objects kept by one CPU for quick reuse.
+// Only touched by its own CPU, with interrupts off.
+struct magazine {
+  int n;
+  void *obj[MAGSIZE];
+};
+
+struct kmem_cache {
+  char *name;
+  uint size;            // object size, rounded up to a word
+  uint perslab;         // objects carved out of each page
+  struct spinlock lock; // protects everything below
+  struct slab *partial; // slabs with at least one free object
+  struct slab *full;    // slabs with every object handed out
+  uint nslab;           // pages owned by this cache
+  struct magazine mag[NCPU];
+};
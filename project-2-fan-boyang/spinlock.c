@@ -96,6 +96,17 @@ holding(struct spinlock *lock)
   return r;
 }
 
+// Does this cpu hold any spinlock? If so it must not sleep.
+int
+holdinglocks(void)
+{
+  int n;
+
+  pushcli();
+  n = mycpu()->ncli;
+  popcli();
+  return n > 1;
+}
 
 // Pushcli/popcli are like cli/sti except that they are matched:
 // it takes two popcli to undo two pushcli.  Also, if interrupts
@@ -0,0 +1,88 @@
+// Growing stack test.
+// Recurses with a KB of locals per frame, well past the one
+// page of stack exec() allocates, and checks that only the
+// pages actually used become resident. Then recurses forever
+// in a child, which should die on the guard page below the
+// stack reserve rather than run into the data below it.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "procmem.h"
+
+#define FRAME   1024
+#define DEPTH   200     // about 200 KB of stack
+
+int
+resident(void)
+{
+  struct procmem pm;
+
+  if(procmem(&pm) < 0){
+    printf(1, "stacktest: procmem failed\n");
+    exit();
+  }
+  return pm.resident;
+}
+
+// Fill a frame at every level and check it on the way back.
+int
+recurse(int depth)
+{
+  char buf[FRAME];
+  int i, sum;
+
+  for(i = 0; i < FRAME; i++)
+    buf[i] = depth + i;
+  sum = depth > 0 ? recurse(depth - 1) : 0;
+  for(i = 0; i < FRAME; i++){
+    if(buf[i] != (char)(depth + i)){
+      printf(1, "stacktest: frame %d was overwritten\n", depth);
+      exit();
+    }
+  }
+  return sum + buf[depth % FRAME];
+}
+
+int
+forever(int depth)
+{
+  volatile char buf[FRAME];
+
+  if(depth < 0)
+    return 0;
+  buf[0] = depth;
+  return forever(depth + 1) + buf[0];
+}
+
+int
+main(int argc, char *argv[])
+{
+  int before, after, pid;
+
+  before = resident();
+  recurse(DEPTH);
+  after = resident();
+  printf(1, "stacktest: %d KB deep recursion grew resident memory by %d pages\n",
+         DEPTH * FRAME / 1024, after - before);
+  if(after - before < DEPTH * FRAME / 4096 ||
+     after - before > DEPTH * FRAME / 4096 + 8){
+    printf(1, "stacktest: expected about %d new pages\n", DEPTH * FRAME / 4096);
+    exit();
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf(1, "stacktest: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    forever(0);
+    printf(1, "stacktest: unbounded recursion returned\n");
+    exit();
+  }
+  wait();
+  printf(1, "stacktest: unbounded recursion was stopped at the guard page\n");
+  printf(1, "stacktest ok\n");
+  exit();
+}
@@ -0,0 +1,459 @@
+// Paging anonymous user memory out to the swap area.
+//
+// mkfs reserves the blocks after the file system for swap, and
+// each PGSIZE/BSIZE of them hold one page: a slot. When
+// kalloc_user() finds memory exhausted it calls swapout(),
+// which sweeps a clock over physical memory looking for a page
+// that has not been touched since the last sweep, writes it to
+// a free slot and frees it.
+//
+// Only anonymous pages are swapped: heap, stack, data and the
+// copies made by copy-on-write faults, whether still shared
+// after fork() or not. Each has a reverse map listing every
+// PTE that maps it, so that the clock can test and clear all
+// their accessed bits, and swap the page out only if those
+// PTEs hold every reference to it. Text pages from the file
+// page cache, shared file mappings and shared memory have no
+// reverse map and stay put.
+//
+// A swapped-out PTE is not present and has PTE_SWAP set; its
+// address bits hold the slot number, and it keeps its PTE_U,
+// PTE_W and PTE_COW bits. Each slot counts the PTEs referring
+// to it. While a slot is being written or read, and after a
+// read until every PTE has come back, the page stays in memory
+// in the slot's swap cache, so that all the PTEs of a page
+// shared copy-on-write come back to the same physical page.
+//
+// vmlock protects the PTEs of anonymous pages, the reverse map
+// and the slots. It comes before ptable.lock and the kalloc()
+// locks.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+#include "slab.h"
+#include "rmap.h"
+#include "swapinfo.h"
+
+#define SLOTBLOCKS (PGSIZE/BSIZE)        // disk blocks per slot
+#define NSLOT      (SWAPBLOCKS/SLOTBLOCKS)
+#define NPAGE      (PHYSTOP/PGSIZE)
+#define SWAPBATCH  8  // pages kalloc_user() frees at a time
+
+// Slot I/O in progress.
+#define SW_WRITING 1
+#define SW_READING 2
+
+struct slot {
+  ushort ref;   // swapped-out PTEs referring to the slot
+  uchar busy;   // SW_WRITING or SW_READING
+  char *page;   // swap cache copy, holding a page reference
+};
+
+struct spinlock vmlock;
+
+static struct {
+  struct rmap *rmap[NPAGE];  // mappings of each anonymous page
+  struct slot slot[NSLOT];
+  uint start;                // first block of the swap area
+  uint nslot;                // usable slots; 0 until swapon()
+  uint hand;                 // page the clock looks at next
+  uint npageout;
+  uint npagein;
+  uint ncachehit;
+  uint nscan;
+  uint nreclaim;
+} swap;
+
+static struct kmem_cache rmapcache;
+static struct buf swapbuf;  // its sleeplock serializes slot I/O
+
+void
+swapinit(void)
+{
+  initlock(&vmlock, "vm");
+  kmem_cache_init(&rmapcache, "rmap", sizeof(struct rmap));
+  initsleeplock(&swapbuf.lock, "swap");
+}
+
+// Start swapping to the swap area of dev. Reads the super
+// block, so it must run in process context.
+void
+swapon(int dev)
+{
+  struct superblock sb;
+
+  readsb(dev, &sb);
+  acquire(&vmlock);
+  swap.start = sb.swapstart;
+  swap.nslot = sb.nswap / SLOTBLOCKS;
+  if(swap.nslot > NSLOT)
+    swap.nslot = NSLOT;
+  release(&vmlock);
+  cprintf("swap: %d pages starting at block %d\n", swap.nslot, swap.start);
+}
+
+// Record that pgdir maps the anonymous page pa at va. If there
+// is no memory for the record, the page just can't be swapped.
+void
+rmapadd(pde_t *pgdir, uint va, uint pa)
+{
+  struct rmap *e;
+
+  if(!holding(&vmlock))
+    panic("rmapadd");
+  if((e = kmem_cache_alloc(&rmapcache)) == 0)
+    return;
+  e->pgdir = pgdir;
+  e->va = va;
+  e->next = swap.rmap[pa/PGSIZE];
+  swap.rmap[pa/PGSIZE] = e;
+}
+
+// pgdir no longer maps pa at va. Does nothing if pa is not an
+// anonymous page.
+void
+rmapdel(pde_t *pgdir, uint va, uint pa)
+{
+  struct rmap **pp, *e;
+
+  if(!holding(&vmlock))
+    panic("rmapdel");
+  for(pp = &swap.rmap[pa/PGSIZE]; (e = *pp) != 0; pp = &e->next){
+    if(e->pgdir == pgdir && e->va == va){
+      *pp = e->next;
+      kmem_cache_free(&rmapcache, e);
+      return;
+    }
+  }
+}
+
+// Is pa an anonymous page? Caller must hold vmlock.
+int
+isanon(uint pa)
+{
+  return swap.rmap[pa/PGSIZE] != 0;
+}
+
+// Return the mappings of anonymous page pa. Caller must hold
+// vmlock.
+struct rmap*
+rmaplist(uint pa)
+{
+  return swap.rmap[pa/PGSIZE];
+}
+
+// Move the mappings of page from to page to, once their PTEs
+// have been pointed at it.
+void
+rmapmove(uint from, uint to)
+{
+  struct rmap *e;
+
+  if(!holding(&vmlock))
+    panic("rmapmove");
+  if((e = swap.rmap[from/PGSIZE]) == 0)
+    return;
+  while(e->next)
+    e = e->next;
+  e->next = swap.rmap[to/PGSIZE];
+  swap.rmap[to/PGSIZE] = swap.rmap[from/PGSIZE];
+  swap.rmap[from/PGSIZE] = 0;
+}
+
+static struct slot*
+pteslot(uint pte)
+{
+  return &swap.slot[PTE_ADDR(pte) >> PTXSHIFT];
+}
+
+// Drop a reference to slot s. Once no PTE refers to it and no
+// I/O is in flight, the swap cache lets go of its page too.
+static void
+slotput(struct slot *s)
+{
+  if(s->ref == 0)
+    panic("slotput");
+  if(--s->ref == 0 && !s->busy && s->page){
+    kfree(s->page);
+    s->page = 0;
+  }
+}
+
+// The swapped-out PTE pte is being copied, by fork(). Fails
+// if the slot already has MAXPGREF references, which only a
+// merged page swapped out can reach.
+int
+swapdup(uint pte)
+{
+  struct slot *s;
+
+  if(!holding(&vmlock))
+    panic("swapdup");
+  s = pteslot(pte);
+  if(s->ref >= MAXPGREF)
+    return -1;
+  s->ref++;
+  return 0;
+}
+
+// The swapped-out PTE pte is being thrown away.
+void
+swapfree(uint pte)
+{
+  if(!holding(&vmlock))
+    panic("swapfree");
+  slotput(pteslot(pte));
+}
+
+// Read or write slot s to or from the page mem.
+static void
+swapio(struct slot *s, char *mem, int write)
+{
+  uint b, i;
+
+  b = swap.start + (s - swap.slot) * SLOTBLOCKS;
+  acquiresleep(&swapbuf.lock);
+  for(i = 0; i < SLOTBLOCKS; i++){
+    swapbuf.dev = ROOTDEV;
+    swapbuf.blockno = b + i;
+    if(write){
+      memmove(swapbuf.data, mem + i*BSIZE, BSIZE);
+      swapbuf.flags = B_DIRTY;
+    } else
+      swapbuf.flags = 0;
+    iderw(&swapbuf);
+    if(!write)
+      memmove(mem + i*BSIZE, swapbuf.data, BSIZE);
+  }
+  releasesleep(&swapbuf.lock);
+}
+
+static pde_t*
+curpgdir(void)
+{
+  struct proc *p = myproc();
+
+  return p ? p->pgdir : 0;
+}
+
+// Advance the clock to the next anonymous page whose PTEs have
+// not been accessed since it last went by, and which nothing
+// but those PTEs holds. Clears the accessed bits on the way.
+// Gives up, returning 0, after looking at *budget pages.
+static uint
+clockpick(int *budget)
+{
+  struct rmap *e;
+  pde_t *cur = curpgdir();
+  pte_t *pte;
+  uint pfn, nmap;
+  int young;
+
+  while(*budget > 0){
+    (*budget)--;
+    pfn = swap.hand;
+    swap.hand = (swap.hand + 1) % NPAGE;
+    if(swap.rmap[pfn] == 0)
+      continue;
+    swap.nscan++;
+    young = 0;
+    nmap = 0;
+    for(e = swap.rmap[pfn]; e; e = e->next){
+      pte = walkpgdir(e->pgdir, (char*)e->va, 0);
+      if(*pte & PTE_A){
+        *pte &= ~PTE_A;
+        if(e->pgdir == cur)
+          invlpg((void*)e->va);
+        young = 1;
+      }
+      nmap++;
+    }
+    if(!young && get_ref_count(pfn*PGSIZE) == nmap)
+      return pfn;
+  }
+  return 0;
+}
+
+static struct slot*
+slotalloc(void)
+{
+  struct slot *s;
+
+  for(s = swap.slot; s < &swap.slot[swap.nslot]; s++){
+    if(s->ref == 0 && !s->busy && s->page == 0){
+      s->busy = SW_WRITING;
+      return s;
+    }
+  }
+  return 0;
+}
+
+// Page out up to n anonymous pages. Returns how many pages were
+// freed. Sleeps on the disk, so the caller must not hold any
+// locks.
+int
+swapout(int n)
+{
+  struct rmap *e;
+  struct slot *s;
+  pde_t *cur = curpgdir();
+  pte_t *pte;
+  uint pfn, nmap, i;
+  int budget, nfreed, ok;
+  char *mem;
+
+  nfreed = 0;
+  budget = 2*NPAGE;
+  acquire(&vmlock);
+  if(swap.nslot == 0){
+    release(&vmlock);
+    return 0;
+  }
+  swap.nreclaim++;
+  while(nfreed < n){
+    if((pfn = clockpick(&budget)) == 0 || (s = slotalloc()) == 0)
+      break;
+
+    // Every process mapping the page must stay off the other
+    // CPUs until its PTE is rewritten, or a stale TLB entry
+    // could outlive the page.
+    ptablelock();
+    ok = 1;
+    for(e = swap.rmap[pfn]; e; e = e->next)
+      if(!pageoutok(e->pgdir, e->va))
+        ok = 0;
+    if(!ok){
+      ptableunlock();
+      s->busy = 0;
+      continue;
+    }
+    nmap = 0;
+    while((e = swap.rmap[pfn]) != 0){
+      pte = walkpgdir(e->pgdir, (char*)e->va, 0);
+      *pte = ((s - swap.slot) << PTXSHIFT) | PTE_SWAP |
+             (*pte & (PTE_U|PTE_W|PTE_COW));
+      if(e->pgdir == cur)
+        invlpg((void*)e->va);
+      s->ref++;
+      swap.rmap[pfn] = e->next;
+      kmem_cache_free(&rmapcache, e);
+      nmap++;
+    }
+    ptableunlock();
+
+    // The swap cache keeps one of the PTEs' references.
+    mem = P2V(pfn*PGSIZE);
+    for(i = 1; i < nmap; i++)
+      kfree(mem);
+    s->page = mem;
+    release(&vmlock);
+    swapio(s, mem, 1);
+    acquire(&vmlock);
+    s->busy = 0;
+    wakeup(s);
+    swap.npageout++;
+    // Faults during the write may have taken the page back.
+    if(get_ref_count(V2P(mem)) == 1)
+      nfreed++;
+    s->page = 0;
+    kfree(mem);
+  }
+  release(&vmlock);
+  return nfreed;
+}
+
+// Bring the page at va of p back from swap. Sleeps, so the
+// caller must not hold any locks.
+int
+swapin(struct proc *p, uint va)
+{
+  struct slot *s;
+  pte_t *pte;
+  char *mem;
+  int readit;
+
+  if(holdinglocks())
+    panic("swapin: locks held");
+  va = PGROUNDDOWN(va);
+  readit = 0;
+  acquire(&vmlock);
+  for(;;){
+    pte = walkpgdir(p->pgdir, (char*)va, 0);
+    if(pte == 0 || !(*pte & PTE_SWAP)){
+      release(&vmlock);
+      return 0;
+    }
+    s = pteslot(*pte);
+    if(s->page){
+      inc_ref_count(V2P(s->page));
+      *pte = V2P(s->page) | (*pte & (PTE_U|PTE_W|PTE_COW)) | PTE_P;
+      rmapadd(p->pgdir, va, V2P(s->page));
+      slotput(s);
+      if(!readit)
+        swap.ncachehit++;
+      release(&vmlock);
+      return 0;
+    }
+    if(s->busy){
+      sleep(s, &vmlock);
+      continue;
+    }
+    s->busy = SW_READING;
+    release(&vmlock);
+    if((mem = kalloc_user()) != 0)
+      swapio(s, mem, 0);
+    acquire(&vmlock);
+    s->busy = 0;
+    wakeup(s);
+    if(mem == 0){
+      release(&vmlock);
+      cprintf("swapin: out of memory\n");
+      return -1;
+    }
+    s->page = mem;
+    swap.npagein++;
+    readit = 1;
+  }
+}
+
+// Allocate a zeroed page of user memory, paging other user
+// memory out if there is none left. Paging out sleeps, so it
+// is only tried if the caller holds no locks.
+char*
+kalloc_user(void)
+{
+  char *mem;
+
+  while((mem = kalloc_zeroed()) == 0)
+    if(holdinglocks() || swapout(SWAPBATCH) == 0)
+      return 0;
+  return mem;
+}
+
+void
+kswapinfo(struct swapinfo *si)
+{
+  struct slot *s;
+
+  acquire(&vmlock);
+  si->nslot = swap.nslot;
+  si->nused = 0;
+  for(s = swap.slot; s < &swap.slot[swap.nslot]; s++)
+    if(s->ref)
+      si->nused++;
+  si->npageout = swap.npageout;
+  si->npagein = swap.npagein;
+  si->ncachehit = swap.ncachehit;
+  si->nscan = swap.nscan;
+  si->nreclaim = swap.nreclaim;
+  release(&vmlock);
+}
@@ -0,0 +1,15 @@
+#ifndef _SWAPINFO_H_
+#define _SWAPINFO_H_
+
+// Swap space use and paging activity since boot, in pages.
+struct swapinfo {
+  uint nslot;      // page slots in the swap area
+  uint nused;      // slots holding a swapped-out page
+  uint npageout;   // pages written out to swap
+  uint npagein;    // pages read back in from swap
+  uint ncachehit;  // swap-ins that found the page still in memory
+  uint nscan;      // pages the clock has looked at
+  uint nreclaim;   // times memory ran out and pages had to go
+};
+
+#endif //_SWAPINFO_H_
@@ -0,0 +1,157 @@
+// Swap stress test.
+// Grows the heap past the free physical memory, by EXTRA pages
+// or by the number given on the command line, writes a pattern
+// to every page and checks it all back, which only works if
+// pages go out to swap and come back intact. Then hands
+// swapped-out pages to write() and checks that a forked child
+// sees the parent's pages, shared copy-on-write through swap.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "buddyinfo.h"
+#include "swapinfo.h"
+
+#define PGSIZE  4096
+#define EXTRA   256   // pages beyond free memory
+#define STEP    256   // bytes between checked words
+
+char *heap;
+int npages;
+
+void
+show(char *what)
+{
+  struct swapinfo si;
+
+  if(swapinfo(&si) < 0){
+    printf(1, "swaptest: swapinfo failed\n");
+    exit();
+  }
+  printf(1, "%s: slots %d used %d out %d in %d cachehit %d scanned %d reclaims %d\n",
+         what, si.nslot, si.nused, si.npageout, si.npagein, si.ncachehit,
+         si.nscan, si.nreclaim);
+}
+
+int
+freepages(void)
+{
+  struct buddyinfo bi;
+  int k, n;
+
+  if(buddyinfo(&bi) < 0){
+    printf(1, "swaptest: buddyinfo failed\n");
+    exit();
+  }
+  n = bi.ncached;
+  for(k = 0; k <= MAXORDER; k++)
+    n += bi.nfree[k] << k;
+  return n;
+}
+
+void
+fill(int seed)
+{
+  int i, j;
+
+  for(i = 0; i < npages; i++)
+    for(j = 0; j < PGSIZE; j += STEP)
+      *(int*)(heap + i*PGSIZE + j) = i ^ seed ^ j;
+}
+
+// Check pages [lo, hi), where the pattern from seed should be.
+void
+check(int seed, int lo, int hi, char *who)
+{
+  int i, j;
+
+  for(i = lo; i < hi; i++){
+    for(j = 0; j < PGSIZE; j += STEP){
+      if(*(int*)(heap + i*PGSIZE + j) != (i ^ seed ^ j)){
+        printf(1, "swaptest: %s: page %d offset %d is wrong\n", who, i, j);
+        exit();
+      }
+    }
+  }
+}
+
+// Write the first pages, which should be swapped out by now,
+// to a file, and read them back into the last pages.
+void
+syscalls(int seed)
+{
+  int fd, i, j, n;
+
+  n = 16;
+  fd = open("swapfile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(1, "swaptest: open failed\n");
+    exit();
+  }
+  if(write(fd, heap, n*PGSIZE) != n*PGSIZE){
+    printf(1, "swaptest: write from swapped pages failed\n");
+    exit();
+  }
+  close(fd);
+  fd = open("swapfile", O_RDONLY);
+  if(read(fd, heap + (npages-n)*PGSIZE, n*PGSIZE) != n*PGSIZE){
+    printf(1, "swaptest: read into swapped pages failed\n");
+    exit();
+  }
+  close(fd);
+  unlink("swapfile");
+  for(i = 0; i < n*PGSIZE; i += STEP){
+    if(heap[i] != heap[(npages-n)*PGSIZE + i]){
+      printf(1, "swaptest: file copy differs at %d\n", i);
+      exit();
+    }
+  }
+  // Put the pattern back.
+  for(i = npages-n; i < npages; i++)
+    for(j = 0; j < PGSIZE; j += STEP)
+      *(int*)(heap + i*PGSIZE + j) = i ^ seed ^ j;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int extra, pid, start;
+
+  extra = argc > 1 ? atoi(argv[1]) : EXTRA;
+  npages = freepages() + extra;
+  printf(1, "swaptest: %d pages, %d more than free memory\n", npages, extra);
+  show("start");
+
+  heap = sbrk(npages * PGSIZE);
+  if(heap == (char*)-1){
+    printf(1, "swaptest: sbrk failed\n");
+    exit();
+  }
+  start = uptime();
+  fill(1);
+  check(1, 0, npages, "first pass");
+  printf(1, "fill and check took %d ticks\n", uptime() - start);
+  show("after first pass");
+
+  syscalls(1);
+  check(1, 0, npages, "after syscalls");
+  show("after syscalls");
+
+  pid = fork();
+  if(pid < 0){
+    printf(1, "swaptest: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    check(1, 0, npages, "child");
+    exit();
+  }
+  wait();
+  check(1, 0, npages, "parent after child");
+  fill(2);
+  check(2, 0, npages, "second pass");
+  show("end");
+  printf(1, "swaptest ok\n");
+  exit();
+}
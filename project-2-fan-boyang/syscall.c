@@ -19,7 +19,7 @@ fetchint(uint addr, int *ip)
 {
   struct proc *curproc = myproc();
 
-  if(addr >= curproc->sz || addr+4 > curproc->sz)
+  if(addr < PGSIZE || addr >= curproc->sz || addr+4 > curproc->sz)
     return -1;
   *ip = *(int*)(addr);
   return 0;
@@ -34,7 +34,7 @@ fetchstr(uint addr, char **pp)
   char *s, *ep;
   struct proc *curproc = myproc();
 
-  if(addr >= curproc->sz)
+  if(addr < PGSIZE || addr >= curproc->sz)
     return -1;
   *pp = (char*)addr;
   ep = (char*)curproc->sz;
@@ -54,16 +54,37 @@ argint(int n, int *ip)
 
 // Fetch the nth word-sized system call argument as a pointer
 // to a block of memory of size bytes.  Check that the pointer
-// lies within the process address space.
+// lies within the process memory, above page 0, or within one
+// file mapping, and read in any part of it still in a file or
+// never touched: system calls touch the block while holding
+// locks, when a page fault can neither sleep nor fail.
 int
 argptr(int n, char **pp, int size)
 {
   int i;
   struct proc *curproc = myproc();
+  struct vma *v;
  
   if(argint(n, &i) < 0)
     return -1;
-  if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
+  if(size < 0 || (uint)i+size < (uint)i || (uint)i < PGSIZE)
+    return -1;
+  if((uint)i >= curproc->sz || (uint)i+size > curproc->sz){
+    if((v = findvma(curproc, i)) == 0 || (uint)i+size > v->end)
+      return -1;
+  }
+  // Keep the range in memory until the system call returns, so
+  // that touching it never has to sleep on swap.
+  if(curproc->pinend == 0){
+    curproc->pinstart = PGROUNDDOWN(i);
+    curproc->pinend = PGROUNDUP(i+size);
+  } else {
+    if(PGROUNDDOWN(i) < curproc->pinstart)
+      curproc->pinstart = PGROUNDDOWN(i);
+    if(PGROUNDUP(i+size) > curproc->pinend)
+      curproc->pinend = PGROUNDUP(i+size);
+  }
+  if(uvmpagein(curproc, i, size, 1) < 0)
     return -1;
   *pp = (char*)i;
   return 0;
@@ -103,6 +124,19 @@ extern int sys_unlink(void);
 extern int sys_wait(void);
 extern int sys_write(void);
 extern int sys_uptime(void);
+extern int sys_buddyinfo(void);
+extern int sys_procmem(void);
+extern int sys_mmap(void);
+extern int sys_munmap(void);
+extern int sys_shmget(void);
+extern int sys_shmat(void);
+extern int sys_shmdt(void);
+extern int sys_swapinfo(void);
+extern int sys_madvise(void);
+extern int sys_largepages(void);
+extern int sys_ksmctl(void);
+extern int sys_vmstat(void);
+extern int sys_shmrm(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -126,6 +160,19 @@ static int (*syscalls[])(void) = {
 [SYS_link]    sys_link,
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
+[SYS_buddyinfo] sys_buddyinfo,
+[SYS_procmem] sys_procmem,
+[SYS_mmap]    sys_mmap,
+[SYS_munmap]  sys_munmap,
+[SYS_shmget]  sys_shmget,
+[SYS_shmat]   sys_shmat,
+[SYS_shmdt]   sys_shmdt,
+[SYS_swapinfo] sys_swapinfo,
+[SYS_madvise] sys_madvise,
+[SYS_largepages] sys_largepages,
+[SYS_ksmctl] sys_ksmctl,
+[SYS_vmstat] sys_vmstat,
+[SYS_shmrm]   sys_shmrm,
 };
 
 void
@@ -137,6 +184,7 @@ syscall(void)
   num = curproc->tf->eax;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
     curproc->tf->eax = syscalls[num]();
+    curproc->pinstart = curproc->pinend = 0;
   } else {
     cprintf("%d %s: unknown sys call %d\n",
             curproc->pid, curproc->name, num);
@@ -20,3 +20,16 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_buddyinfo 22
+#define SYS_procmem 23
+#define SYS_mmap   24
+#define SYS_munmap 25
+#define SYS_shmget 26
+#define SYS_shmat  27
+#define SYS_shmdt  28
+#define SYS_swapinfo 29
+#define SYS_madvise 30
+#define SYS_largepages 31
+#define SYS_ksmctl 32
+#define SYS_vmstat 33
+#define SYS_shmrm  34
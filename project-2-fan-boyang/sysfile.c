@@ -443,3 +443,38 @@ sys_pipe(void)
   fd[1] = fd1;
   return 0;
 }
+
+int
+sys_mmap(void)
+{
+  int addr, len, prot, flags, off;
+  struct file *f;
+
+  // addr is only a hint, and is ignored.
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0 || argint(2, &prot) < 0 ||
+     argint(3, &flags) < 0 || argfd(4, 0, &f) < 0 || argint(5, &off) < 0)
+    return -1;
+  if(len <= 0 || off < 0)
+    return -1;
+  return mmap(f, len, prot, flags, off);
+}
+
+int
+sys_munmap(void)
+{
+  int addr, len;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0)
+    return -1;
+  return munmap(addr, len);
+}
+
+int
+sys_madvise(void)
+{
+  int addr, len, advice;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0 || argint(2, &advice) < 0)
+    return -1;
+  return madvise(addr, len, advice);
+}
@@ -6,6 +6,11 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "buddyinfo.h"
+#include "procmem.h"
+#include "swapinfo.h"
+#include "ksminfo.h"
+#include "vmstat.h"
 
 int
 sys_fork(void)
@@ -89,3 +94,136 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+// Copy physical allocator statistics to user space.
+int
+sys_buddyinfo(void)
+{
+  struct buddyinfo *ubi;
+  struct buddyinfo bi;
+
+  if(argptr(0, (char**)&ubi, sizeof(*ubi)) < 0)
+    return -1;
+  // Gather into a kernel copy first: storing to a COW page
+  // faults, and the fault handler may need kmem.lock.
+  kbuddyinfo(&bi);
+  *ubi = bi;
+  return 0;
+}
+
+int
+sys_procmem(void)
+{
+  struct procmem *upm;
+  struct procmem pm;
+  struct proc *curproc = myproc();
+
+  if(argptr(0, (char**)&upm, sizeof(*upm)) < 0)
+    return -1;
+  pm.reserved = PGROUNDUP(curproc->sz) / PGSIZE;
+  pm.resident = uvmresident(curproc->pgdir, curproc->sz, &pm.nzero);
+  pm.nzfod = curproc->nzfod;
+  pm.npagein = curproc->npagein;
+  pm.nshared = curproc->nshared;
+  pm.nlarge = curproc->nlarge;
+  *upm = pm;
+  return 0;
+}
+
+int
+sys_shmget(void)
+{
+  int key, size;
+
+  if(argint(0, &key) < 0 || argint(1, &size) < 0 || size <= 0)
+    return -1;
+  return shmget(key, size);
+}
+
+int
+sys_shmat(void)
+{
+  int key;
+
+  if(argint(0, &key) < 0)
+    return -1;
+  return shmat(key);
+}
+
+int
+sys_shmdt(void)
+{
+  int addr;
+
+  if(argint(0, &addr) < 0)
+    return -1;
+  return shmdt(addr);
+}
+
+int
+sys_shmrm(void)
+{
+  int key;
+
+  if(argint(0, &key) < 0)
+    return -1;
+  return shmrm(key);
+}
+
+int
+sys_swapinfo(void)
+{
+  struct swapinfo *usi;
+  struct swapinfo si;
+
+  if(argptr(0, (char**)&usi, sizeof(*usi)) < 0)
+    return -1;
+  kswapinfo(&si);
+  *usi = si;
+  return 0;
+}
+
+// Ask for heap to be mapped with 4 MB large pages where it
+// can be, or not. Returns the previous setting. Inherited by
+// fork() and kept across exec().
+int
+sys_largepages(void)
+{
+  struct proc *curproc = myproc();
+  int on, old;
+
+  if(argint(0, &on) < 0)
+    return -1;
+  old = curproc->largepages;
+  curproc->largepages = on != 0;
+  return old;
+}
+
+// Set the same-page merging scan rate, in pages per tick, or
+// leave it alone if rate is negative, and report merging so far.
+int
+sys_ksmctl(void)
+{
+  struct ksminfo *uki;
+  struct ksminfo ki;
+  int rate;
+
+  if(argint(0, &rate) < 0 || argptr(1, (char**)&uki, sizeof(*uki)) < 0)
+    return -1;
+  ksmctl(rate, &ki);
+  *uki = ki;
+  return 0;
+}
+
+int
+sys_vmstat(void)
+{
+  struct vmstat *uvs;
+  struct vmstat vs;
+
+  if(argptr(0, (char**)&uvs, sizeof(*uvs)) < 0)
+    return -1;
+  kvmstat(&vs);
+  *uvs = vs;
+  return 0;
+}
@@ -0,0 +1,70 @@
+// TLB benchmark for large pages.
+// A child maps a big heap, 4 MB-aligned, touches every page
+// and then reads one word from each of NSTEP pseudo-random
+// pages, which misses the TLB nearly every time with 4 KB
+// pages. It runs once with ordinary pages and once with
+// largepages() on, and prints the ticks each walk took.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "procmem.h"
+
+#define PGSIZE   4096
+#define LGPGSIZE (4*1024*1024)
+#define NSTEP    (4*1024*1024)
+
+int mb = 64;   // heap size in MB, or argv[1]
+
+void
+walk(int large)
+{
+  struct procmem pm;
+  char *heap;
+  uint cur, npages, i, x, sum;
+  int start, t;
+
+  largepages(large);
+  // Start the heap on a 4 MB boundary.
+  cur = (uint)sbrk(0);
+  if(sbrk((LGPGSIZE - cur % LGPGSIZE) % LGPGSIZE) == (char*)-1 ||
+     (heap = sbrk(mb * 1024 * 1024)) == (char*)-1){
+    printf(1, "tlbbench: sbrk failed\n");
+    exit();
+  }
+  npages = mb * 1024 * 1024 / PGSIZE;
+
+  start = uptime();
+  for(i = 0; i < npages; i++)
+    heap[i * PGSIZE] = i;
+  t = uptime() - start;
+
+  x = 1;
+  sum = 0;
+  start = uptime();
+  for(i = 0; i < NSTEP; i++){
+    x = x * 1103515245 + 12345;
+    sum += heap[((x >> 8) % npages) * PGSIZE + (x & 0xfc)];
+  }
+  procmem(&pm);
+  printf(1, "%s pages: touch %d ticks, random walk %d ticks, %d large pages (sum %d)\n",
+         large ? "4 MB" : "4 KB", t, uptime() - start, pm.nlarge, sum);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int large;
+
+  if(argc > 1)
+    mb = atoi(argv[1]);
+  printf(1, "tlbbench: %d MB heap, %d random reads\n", mb, NSTEP);
+  for(large = 0; large <= 1; large++){
+    if(fork() == 0){
+      walk(large);
+      exit();
+    }
+    wait();
+  }
+  exit();
+}
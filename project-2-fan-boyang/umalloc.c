@@ -2,9 +2,16 @@
 #include "stat.h"
 #include "user.h"
 #include "param.h"
+#include "mman.h"
 
 // Memory allocator by Kernighan and Ritchie,
 // The C programming Language, 2nd ed.  Section 8.7.
+//
+// free() hands the whole pages of big free blocks back to the
+// kernel with madvise(); they come back zeroed when reused.
+
+#define PGSIZE   4096
+#define RELEASE  (16*PGSIZE)  // least memory worth giving back
 
 typedef long Align;
 
@@ -21,12 +28,13 @@ typedef union header Header;
 static Header base;
 static Header *freep;
 
-void
-free(void *ap)
+// Put block bp on the free list, merging it with its
+// neighbours. Returns the free block that now holds it.
+static Header*
+putfree(Header *bp)
 {
-  Header *bp, *p;
+  Header *p, *blk;
 
-  bp = (Header*)ap - 1;
   for(p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
     if(p >= p->s.ptr && (bp > p || bp < p->s.ptr))
       break;
@@ -38,9 +46,46 @@ free(void *ap)
   if(p + p->s.size == bp){
     p->s.size += bp->s.size;
     p->s.ptr = bp->s.ptr;
-  } else
+    blk = p;
+  } else {
     p->s.ptr = bp;
+    blk = bp;
+  }
   freep = p;
+  return blk;
+}
+
+// Give back the whole pages of free block blk that the newly
+// freed nunits at bp cover, except the one holding blk's
+// header. Looking only at what was just freed keeps freeing
+// next to a big free block cheap.
+static void
+giveback(Header *bp, uint nunits, Header *blk)
+{
+  uint lo, hi, start, end;
+
+  start = ((uint)(blk + 1) + PGSIZE - 1) & ~(PGSIZE - 1);
+  end = (uint)(blk + blk->s.size) & ~(PGSIZE - 1);
+  lo = (uint)bp & ~(PGSIZE - 1);
+  hi = ((uint)(bp + nunits) + PGSIZE - 1) & ~(PGSIZE - 1);
+  if(lo < start)
+    lo = start;
+  if(hi > end)
+    hi = end;
+  if(hi >= lo + RELEASE)
+    madvise((void*)lo, hi - lo, MADV_DONTNEED);
+}
+
+void
+free(void *ap)
+{
+  Header *bp, *blk;
+  uint nunits;
+
+  bp = (Header*)ap - 1;
+  nunits = bp->s.size;
+  blk = putfree(bp);
+  giveback(bp, nunits, blk);
 }
 
 static Header*
@@ -56,7 +101,7 @@ morecore(uint nu)
     return 0;
   hp = (Header*)p;
   hp->s.size = nu;
-  free((void*)(hp + 1));
+  putfree(hp);
   return freep;
 }
 
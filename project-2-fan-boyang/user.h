@@ -1,5 +1,10 @@
 struct stat;
 struct rtcdate;
+struct buddyinfo;
+struct procmem;
+struct swapinfo;
+struct ksminfo;
+struct vmstat;
 
 // system calls
 int fork(void);
@@ -23,6 +28,19 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int buddyinfo(struct buddyinfo*);
+int procmem(struct procmem*);
+void* mmap(void*, int, int, int, int, int);
+int munmap(void*, int);
+int shmget(int, int);
+void* shmat(int);
+int shmdt(void*);
+int swapinfo(struct swapinfo*);
+int madvise(void*, int, int);
+int largepages(int);
+int ksmctl(int, struct ksminfo*);
+int vmstat(struct vmstat*);
+int shmrm(int);
 
 // ulib.c
 int stat(const char*, struct stat*);
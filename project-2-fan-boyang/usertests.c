@@ -1589,6 +1589,146 @@ validatetest(void)
   printf(stdout, "validate ok\n");
 }
 
+// map the shared zero page more times than a page reference
+// count could hold, fork, and write to some of the mappings.
+void
+zeropagetest(void)
+{
+  char *a, *oldbrk;
+  int i, n, pid, sum;
+
+  printf(stdout, "zero page test\n");
+  n = 65536 + 1024;
+  oldbrk = sbrk(0);
+  if((a = sbrk(n * 4096)) == (char*)-1){
+    printf(stdout, "zero page test: sbrk failed\n");
+    exit();
+  }
+  sum = 0;
+  for(i = 0; i < n; i++)
+    sum += a[i * 4096];
+  if(sum != 0){
+    printf(stdout, "zero page test: untouched page not zero\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "zero page test: fork failed\n");
+    exit();
+  }
+  for(i = 0; i < n; i += 4096){
+    a[i * 4096] = 1;
+    if(a[i * 4096] != 1 || a[(i + 1) * 4096] != 0){
+      printf(stdout, "zero page test: copy-on-write failed\n");
+      exit();
+    }
+  }
+  if(pid == 0)
+    exit();
+  wait();
+  if(sbrk(-(n * 4096)) == (char*)-1 || sbrk(0) != oldbrk){
+    printf(stdout, "zero page test: sbrk shrink failed\n");
+    exit();
+  }
+  printf(stdout, "zero page test ok\n");
+}
+
+// pass page 0, which is never mapped, to system calls, and
+// read a file into heap pages that were never touched.
+void
+nullptrtest(void)
+{
+  char *a;
+  int fd, n;
+
+  printf(stdout, "null pointer test\n");
+  if(open((char*)0, 0) != -1 || link((char*)0, "x") != -1 ||
+     read(0, (char*)0, 1) != -1 || pipe((int*)0) != -1){
+    printf(stdout, "null pointer test: page 0 accepted\n");
+    exit();
+  }
+  a = sbrk(8192);
+  fd = open("README", 0);
+  if(fd < 0){
+    printf(stdout, "null pointer test: open README failed\n");
+    exit();
+  }
+  n = read(fd, a + 100, 8000);
+  close(fd);
+  if(n <= 0 || a[100] == 0){
+    printf(stdout, "null pointer test: read into new heap failed\n");
+    exit();
+  }
+  sbrk(-8192);
+  printf(stdout, "null pointer test ok\n");
+}
+
+// writing to a program that is running, like this one, must
+// fail: it pages its text in from the file as it runs.
+void
+textbusytest(void)
+{
+  char c;
+  int fd;
+
+  printf(stdout, "text busy test\n");
+  if((fd = open("usertests", O_RDONLY)) < 0){
+    printf(stdout, "text busy test: open usertests failed\n");
+    exit();
+  }
+  if(read(fd, &c, 1) != 1){
+    printf(stdout, "text busy test: read failed\n");
+    exit();
+  }
+  close(fd);
+  // Write back the same byte, in case the write goes through.
+  if((fd = open("usertests", O_RDWR)) < 0){
+    printf(stdout, "text busy test: open usertests failed\n");
+    exit();
+  }
+  if(write(fd, &c, 1) != -1){
+    printf(stdout, "text busy test: wrote to a running program\n");
+    exit();
+  }
+  close(fd);
+  printf(stdout, "text busy test ok\n");
+}
+
+// shmrm() must free segments that were never attached, and
+// keep a removed one mapped until it is detached.
+void
+shmrmtest(void)
+{
+  char *a;
+  int i;
+
+  printf(stdout, "shmrm test\n");
+  for(i = 0; i < 2 * NSHM; i++){
+    if(shmget(1000 + i, 4096) != 0 || shmrm(1000 + i) != 0){
+      printf(stdout, "shmrm test: segment %d leaked\n", i);
+      exit();
+    }
+  }
+  if(shmrm(1000) != -1){
+    printf(stdout, "shmrm test: removed a segment twice\n");
+    exit();
+  }
+  if(shmget(1000, 4096) != 0 || (a = shmat(1000)) == (char*)-1){
+    printf(stdout, "shmrm test: shmget/shmat failed\n");
+    exit();
+  }
+  a[0] = 'x';
+  if(shmrm(1000) != 0 || shmat(1000) != (char*)-1){
+    printf(stdout, "shmrm test: attached a removed segment\n");
+    exit();
+  }
+  if(a[0] != 'x' || shmdt(a) != 0){
+    printf(stdout, "shmrm test: removed segment unmapped early\n");
+    exit();
+  }
+  printf(stdout, "shmrm test ok\n");
+}
+
 // does unintialized data start out zero?
 char uninit[10000];
 void
@@ -1768,6 +1908,10 @@ main(int argc, char *argv[])
   bigargtest();
   bsstest();
   sbrktest();
+  zeropagetest();
+  nullptrtest();
+  textbusytest();
+  shmrmtest();
   validatetest();
 
   opentest();
@@ -6,9 +6,16 @@
 #include "mmu.h"
 #include "proc.h"
 #include "elf.h"
+#include "mman.h"
+#include "vmstat.h"
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
+static char *zeropage;  // mapped copy-on-write for untouched memory
+static char *scrappage; // see killfault()
+
+#define LGORDER   10                  // kalloc_pages() order of a large page
+#define LGPGSIZE  (PGSIZE << LGORDER) // 4 MB, mapped by one PDE
 
 // Set up CPU's kernel segment descriptors.
 // Run once on entry on each CPU.
@@ -31,21 +38,23 @@ seginit(void)
 
 // Return the address of the PTE in page table pgdir
 // that corresponds to virtual address va.  If alloc!=0,
-// create any required page table pages.
-static pte_t *
+// create any required page table pages. Returns 0 if va is
+// in a large page, which has no page table.
+pte_t *
 walkpgdir(pde_t *pgdir, const void *va, int alloc)
 {
   pde_t *pde;
   pte_t *pgtab;
 
   pde = &pgdir[PDX(va)];
+  if(*pde & PTE_PS)
+    return 0;
   if(*pde & PTE_P){
     pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
   } else {
-    if(!alloc || (pgtab = (pte_t*)kalloc()) == 0)
-      return 0;
     // Make sure all those PTE_P bits are zero.
-    memset(pgtab, 0, PGSIZE);
+    if(!alloc || (pgtab = (pte_t*)kalloc_zeroed()) == 0)
+      return 0;
     // The permissions here are overly generous, but they can
     // be further restricted by the permissions in the page table
     // entries, if necessary.
@@ -57,7 +66,7 @@ walkpgdir(pde_t *pgdir, const void *va, int alloc)
 // Create PTEs for virtual addresses starting at va that refer to
 // physical addresses starting at pa. va and size might not
 // be page-aligned.
-static int
+int
 mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
 {
   char *a, *last;
@@ -99,6 +108,18 @@ mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
 // The kernel allocates physical memory for its heap and for user memory
 // between V2P(end) and the end of physical memory (PHYSTOP)
 // (directly addressable from end..P2V(PHYSTOP)).
+//
+// Heap may also be mapped with 4 MB large pages: a directory
+// entry with PTE_PS set maps a 4 MB-aligned block from
+// kalloc_pages(LGORDER) directly, with no page table. Large
+// pages belong to one process only. fork() copies them, they
+// are never swapped, and they are freed once the heap shrinks
+// below them.
+//
+// The kernel half is only built once, in kpgdir. Every process
+// page directory points at kpgdir's kernel page-table pages, so
+// creating an address space allocates just the directory page,
+// and freevm() leaves those shared page tables alone.
 
 // This table defines the kernel's mappings, which are present in
 // every process's page table.
@@ -119,28 +140,34 @@ pde_t*
 setupkvm(void)
 {
   pde_t *pgdir;
-  struct kmap *k;
 
-  if((pgdir = (pde_t*)kalloc()) == 0)
+  if((pgdir = (pde_t*)kalloc_zeroed()) == 0)
     return 0;
-  memset(pgdir, 0, PGSIZE);
-  if (P2V(PHYSTOP) > (void*)DEVSPACE)
-    panic("PHYSTOP too high");
-  for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
-    if(mappages(pgdir, k->virt, k->phys_end - k->phys_start,
-                (uint)k->phys_start, k->perm) < 0) {
-      freevm(pgdir);
-      return 0;
-    }
+  memmove(&pgdir[PDX(KERNBASE)], &kpgdir[PDX(KERNBASE)],
+          (NPDENTRIES - PDX(KERNBASE)) * sizeof(pde_t));
   return pgdir;
 }
 
 // Allocate one page table for the machine for the kernel address
-// space for scheduler processes.
+// space for scheduler processes. Its kernel page-table pages are
+// shared by every process. Also allocate the shared zero page
+// and the scrap page.
 void
 kvmalloc(void)
 {
-  kpgdir = setupkvm();
+  struct kmap *k;
+
+  if((kpgdir = (pde_t*)kalloc_zeroed()) == 0)
+    panic("kvmalloc");
+  if (P2V(PHYSTOP) > (void*)DEVSPACE)
+    panic("PHYSTOP too high");
+  for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
+    if(mappages(kpgdir, k->virt, k->phys_end - k->phys_start,
+                (uint)k->phys_start, k->perm) < 0)
+      panic("kvmalloc: out of memory");
+  // These are never freed and keep no reference count.
+  if((zeropage = kalloc_perm()) == 0 || (scrappage = kalloc_perm()) == 0)
+    panic("kvmalloc: zero page");
   switchkvm();
 }
 
@@ -186,9 +213,11 @@ inituvm(pde_t *pgdir, char *init, uint sz)
 
   if(sz >= PGSIZE)
     panic("inituvm: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kalloc_zeroed();
+  acquire(&vmlock);
   mappages(pgdir, 0, PGSIZE, V2P(mem), PTE_W|PTE_U);
+  rmapadd(pgdir, 0, V2P(mem));
+  release(&vmlock);
   memmove(mem, init, sz);
 }
 
@@ -231,19 +260,22 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 
   a = PGROUNDUP(oldsz);
   for(; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = kalloc_user();
     if(mem == 0){
       cprintf("allocuvm out of memory\n");
       deallocuvm(pgdir, newsz, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
+    acquire(&vmlock);
     if(mappages(pgdir, (char*)a, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
+      release(&vmlock);
       cprintf("allocuvm out of memory (2)\n");
       deallocuvm(pgdir, newsz, oldsz);
       kfree(mem);
       return 0;
     }
+    rmapadd(pgdir, a, V2P(mem));
+    release(&vmlock);
   }
   return newsz;
 }
@@ -255,31 +287,48 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 int
 deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 {
+  pde_t *pde;
   pte_t *pte;
-  uint a, pa;
+  uint a, pa, lg;
 
   if(newsz >= oldsz)
     return oldsz;
 
   a = PGROUNDUP(newsz);
+  acquire(&vmlock);
   for(; a  < oldsz; a += PGSIZE){
     pte = walkpgdir(pgdir, (char*)a, 0);
-    if(!pte)
+    if(!pte){
+      // A large page goes once all of it is being freed. The
+      // part of one above newsz stays mapped but is zeroed, so
+      // that growing again finds it zero-filled.
+      pde = &pgdir[PDX(a)];
+      lg = PGADDR(PDX(a), 0, 0);
+      if((*pde & PTE_PS) && lg >= PGROUNDUP(newsz)){
+        kfree_pages(P2V(PTE_ADDR(*pde)), LGORDER);
+        *pde = 0;
+      } else if(*pde & PTE_PS)
+        memset((char*)P2V(PTE_ADDR(*pde)) + (a - lg), 0, LGPGSIZE - (a - lg));
       a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
-    else if((*pte & PTE_P) != 0){
+    } else if((*pte & PTE_P) != 0){
       pa = PTE_ADDR(*pte);
       if(pa == 0)
         panic("kfree");
+      rmapdel(pgdir, a, pa);
       char *v = P2V(pa);
       kfree(v);
       *pte = 0;
+    } else if(*pte & PTE_SWAP){
+      swapfree(*pte);
+      *pte = 0;
     }
   }
+  release(&vmlock);
   return newsz;
 }
 
 // Free a page table and all the physical memory pages
-// in the user part.
+// in the user part. The kernel part belongs to kpgdir.
 void
 freevm(pde_t *pgdir)
 {
@@ -288,7 +337,7 @@ freevm(pde_t *pgdir)
   if(pgdir == 0)
     panic("freevm: no pgdir");
   deallocuvm(pgdir, KERNBASE, 0);
-  for(i = 0; i < NPDENTRIES; i++){
+  for(i = 0; i < PDX(KERNBASE); i++){
     if(pgdir[i] & PTE_P){
       char * v = P2V(PTE_ADDR(pgdir[i]));
       kfree(v);
@@ -310,43 +359,160 @@ clearpteu(pde_t *pgdir, char *uva)
   *pte &= ~PTE_U;
 }
 
-// Given a parent process's page table, create a copy
-// of it for a child.
-pde_t*
-copyuvm(pde_t *pgdir, uint sz)
+// A batch of user pages whose PTEs lost write permission and
+// must be flushed from this CPU's TLB. Small batches are
+// flushed a page at a time with invlpg, so the rest of the
+// TLB survives; bigger ones reload cr3 once.
+#define NFLUSH 16
+
+struct flushbatch {
+  int n;
+  uint va[NFLUSH];
+};
+
+static void
+flushadd(struct flushbatch *fb, uint va)
 {
-  pde_t *d;
-  pte_t *pte;
+  if(fb->n < NFLUSH)
+    fb->va[fb->n] = va;
+  fb->n++;
+}
+
+static void
+flushbatch(struct flushbatch *fb, pde_t *pgdir)
+{
+  int i;
+
+  if(fb->n > NFLUSH)
+    lcr3(V2P(pgdir));
+  else
+    for(i = 0; i < fb->n; i++)
+      invlpg((void*)fb->va[i]);
+  fb->n = 0;
+}
+
+// Map the present and swapped-out pages of [start, end) in
+// pgdir into d too. Writable pages become copy-on-write in
+// both, unless shared is set. Large pages are copied. Caller
+// must hold vmlock.
+static int
+copyrange(pde_t *pgdir, pde_t *d, uint start, uint end, int shared,
+          struct flushbatch *fb)
+{
+  pte_t *pte, *dpte;
   uint pa, i, flags;
-  // char *mem;
+  char *mem;
 
-  if((d = setupkvm()) == 0)
-    return 0;
-  for(i = PGSIZE; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
-      panic("copyuvm: pte should exist");
+  for(i = start; i < end; i += PGSIZE){
+    // Pages that were never touched stay lazy in the child.
+    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0){
+      if(pgdir[PDX(i)] & PTE_PS){
+        if((mem = kalloc_pages(LGORDER)) == 0)
+          return -1;
+        memmove(mem, P2V(PTE_ADDR(pgdir[PDX(i)])), LGPGSIZE);
+        d[PDX(i)] = V2P(mem) | PTE_FLAGS(pgdir[PDX(i)]);
+      }
+      i = PGADDR(PDX(i) + 1, 0, 0) - PGSIZE;
+      continue;
+    }
+    if(*pte & PTE_SWAP){
+      // Not present, so there is nothing to flush.
+      if(!shared && (*pte & PTE_W))
+        *pte = (*pte & ~PTE_W) | PTE_COW;
+      if((dpte = walkpgdir(d, (void*)i, 1)) == 0 || swapdup(*pte) < 0)
+        return -1;
+      *dpte = *pte;
+      continue;
+    }
     if(!(*pte & PTE_P))
-      panic("copyuvm: page not present");
+      continue;
 
-    *pte &= ~PTE_W;
-    *pte |= PTE_COW;
+    if(!shared && (*pte & PTE_W)){
+      flushadd(fb, i);
+      *pte &= ~PTE_W;
+      *pte |= PTE_COW;
+    }
 
     pa = PTE_ADDR(*pte);
     flags = PTE_FLAGS(*pte);
+    if(get_ref_count(pa) >= MAXPGREF){
+      // Only merged pages get this many references; sharing
+      // one more would overflow the count, so copy it.
+      if((mem = kalloc()) == 0)
+        return -1;
+      memmove(mem, P2V(pa), PGSIZE);
+      if(flags & PTE_COW)
+        flags = (flags & ~PTE_COW) | PTE_W;
+      if(mappages(d, (void*)i, PGSIZE, V2P(mem), flags) < 0){
+        kfree(mem);
+        return -1;
+      }
+      rmapadd(d, i, V2P(mem));
+      continue;
+    }
     if( mappages(d, (void*)i, PGSIZE, pa, flags) < 0 )
-      goto bad;
+      return -1;
     inc_ref_count(pa);
-
+    if(isanon(pa))
+      rmapadd(d, i, pa);
   }
-  lcr3(V2P(pgdir));
+  return 0;
+}
+
+// Given a parent process, create a copy of its page table
+// for a child. p must be the current process.
+pde_t*
+copyuvm(struct proc *p)
+{
+  pde_t *d;
+  struct vma *v;
+  struct flushbatch fb;
+
+  if((d = setupkvm()) == 0)
+    return 0;
+  fb.n = 0;
+  acquire(&vmlock);
+  if(copyrange(p->pgdir, d, PGSIZE, p->sz, 0, &fb) < 0)
+    goto bad;
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->start && copyrange(p->pgdir, d, v->start, v->end,
+                             v->flags == MAP_SHARED, &fb) < 0)
+      goto bad;
+  release(&vmlock);
+  flushbatch(&fb, p->pgdir);
   return d;
 
 bad:
+  release(&vmlock);
   freevm(d);
-  lcr3(V2P(pgdir));
+  flushbatch(&fb, p->pgdir);
   return 0;
 }
 
+// Count the user pages below sz that are backed by physical memory,
+// and in *nzero those of them that map the shared zero page.
+uint
+uvmresident(pde_t *pgdir, uint sz, uint *nzero)
+{
+  pte_t *pte;
+  uint a, n;
+
+  n = 0;
+  *nzero = 0;
+  for(a = 0; a < sz; a += PGSIZE){
+    if((pte = walkpgdir(pgdir, (char*)a, 0)) == 0){
+      if(pgdir[PDX(a)] & PTE_PS)
+        n += NPTENTRIES;
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+    } else if((*pte & (PTE_P|PTE_U)) == (PTE_P|PTE_U)){
+      n++;
+      if(PTE_ADDR(*pte) == V2P(zeropage))
+        (*nzero)++;
+    }
+  }
+  return n;
+}
+
 //PAGEBREAK!
 // Map user virtual address to kernel address.
 char*
@@ -355,7 +521,7 @@ uva2ka(pde_t *pgdir, char *uva)
   pte_t *pte;
 
   pte = walkpgdir(pgdir, uva, 0);
-  if((*pte & PTE_P) == 0)
+  if(pte == 0 || (*pte & PTE_P) == 0)
     return 0;
   if((*pte & PTE_U) == 0)
     return 0;
@@ -395,6 +561,242 @@ copyout(pde_t *pgdir, uint va, void *p, uint len)
 //PAGEBREAK!
 // Blank page.
 
+// Return the program segment of p that covers va, if any.
+static struct vmseg*
+findseg(struct proc *p, uint va)
+{
+  struct vmseg *s;
+
+  for(s = p->seg; s < &p->seg[p->nseg]; s++)
+    if(va >= s->va && va < s->va + s->memsz)
+      return s;
+  return 0;
+}
+
+// Map a page of a program segment that lies entirely within
+// the file from the text page cache. The page is shared with
+// every other process running the same executable, so it is
+// mapped copy-on-write. Returns -1 if the page should be read
+// in privately instead.
+static int
+pageshared(struct proc *p, struct vmseg *s, uint va)
+{
+  char *mem;
+
+  ilock(p->exe);
+  mem = pcache_get(p->exe, s->off + (va - s->va), 0);
+  iunlock(p->exe);
+  if(mem == 0)
+    return -1;
+  if(mappages(p->pgdir, (char*)va, PGSIZE, V2P(mem), PTE_U|PTE_COW) < 0){
+    kfree(mem);
+    return -1;
+  }
+  p->nshared++;
+  return 0;
+}
+
+// Back the 4 MB-aligned stretch of p around va with a large
+// page, if p asked for large pages and the whole stretch is
+// heap that has never been touched.
+static int
+pagein_large(struct proc *p, uint va)
+{
+  struct vmseg *s;
+  pde_t *pde;
+  char *mem;
+  uint start;
+
+  if(!p->largepages)
+    return -1;
+  start = va & ~(LGPGSIZE - 1);
+  if(start < PGSIZE || start + LGPGSIZE > p->sz)
+    return -1;
+  for(s = p->seg; s < &p->seg[p->nseg]; s++)
+    if(s->va < start + LGPGSIZE && start < s->va + s->memsz)
+      return -1;
+  pde = &p->pgdir[PDX(start)];
+  if(*pde & PTE_P)
+    return -1;
+  if((mem = kalloc_pages(LGORDER)) == 0)
+    return -1;
+  memset(mem, 0, LGPGSIZE);
+  *pde = V2P(mem) | PTE_PS | PTE_P | PTE_W | PTE_U;
+  p->nlarge++;
+  return 0;
+}
+
+// MADV_DONTNEED for the part of [start, end) in the large page
+// mapping va in p: free the large page if the range covers all
+// of it, or else zero the part it covers in place, as a 4 MB
+// block cannot be freed in pieces. Either way it reads as zero
+// afterwards. p must be the current process.
+void
+uvmdroplarge(struct proc *p, uint va, uint start, uint end)
+{
+  pde_t *pde;
+  uint lo, hi;
+
+  lo = va & ~(LGPGSIZE - 1);
+  hi = lo + LGPGSIZE;
+  pde = &p->pgdir[PDX(lo)];
+  if(!(*pde & PTE_PS))
+    return;
+  if(start <= lo && hi <= end){
+    kfree_pages(P2V(PTE_ADDR(*pde)), LGORDER);
+    *pde = 0;
+    invlpg((void*)lo);
+    return;
+  }
+  if(start > lo)
+    lo = start;
+  if(end < hi)
+    hi = end;
+  memset((char*)lo, 0, hi - lo);
+}
+
+// Back a page of p that is not present: either swapped out,
+// part of a program segment still in the executable, or heap
+// that growproc() reserved but never allocated. Page 0 is never
+// mapped, so that null pointer dereferences still fault.
+// Demand-zero pages that are only being read map the shared
+// zero page copy-on-write, so they take no memory until they
+// are written. Reading from swap or the executable sleeps, so
+// the caller must not hold any locks.
+static int
+pagein(struct proc *p, uint va, int write)
+{
+  struct vmseg *s;
+  pte_t *pte;
+  char *mem;
+  uint n;
+
+  va = PGROUNDDOWN(va);
+  // A large page is present; walkpgdir() finds no PTE in it.
+  if(p->pgdir[PDX(va)] & PTE_PS)
+    return 0;
+  pte = walkpgdir(p->pgdir, (char*)va, 0);
+  if(pte && (*pte & PTE_SWAP)){
+    vmcount(VM_SWAPIN, 1);
+    return swapin(p, va);
+  }
+  if(va < PGSIZE)
+    return -1;
+  if(va >= p->sz)
+    return mmapfault(p, va);
+  s = findseg(p, va);
+  if(s && va < s->va + s->filesz && holdinglocks())
+    panic("pagein: locks held");
+  if(s && va + PGSIZE <= s->va + s->filesz && pageshared(p, s, va) == 0){
+    vmcount(VM_FILEFAULT, 1);
+    return 0;
+  }
+  if(s == 0 && pagein_large(p, va) == 0)
+    return 0;
+  if(!write && (s == 0 || va >= s->va + s->filesz)){
+    if(mappages(p->pgdir, (char*)va, PGSIZE, V2P(zeropage), PTE_U|PTE_COW) < 0)
+      return -1;
+    p->nzfod++;
+    vmcount(VM_ZEROPAGE, 1);
+    return 0;
+  }
+  if((mem = kalloc_user()) == 0){
+    cprintf("pagein: out of memory\n");
+    return -1;
+  }
+  if(s && va < s->va + s->filesz){
+    n = s->va + s->filesz - va;
+    if(n > PGSIZE)
+      n = PGSIZE;
+    ilock(p->exe);
+    if(readi(p->exe, mem, s->off + (va - s->va), n) != n){
+      iunlock(p->exe);
+      kfree(mem);
+      return -1;
+    }
+    iunlock(p->exe);
+    p->npagein++;
+    vmcount(VM_FILEFAULT, 1);
+  } else {
+    p->nzfod++;
+    vmcount(VM_ZEROFILL, 1);
+  }
+  acquire(&vmlock);
+  if(mappages(p->pgdir, (char*)va, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
+    release(&vmlock);
+    kfree(mem);
+    return -1;
+  }
+  rmapadd(p->pgdir, va, V2P(mem));
+  release(&vmlock);
+  return 0;
+}
+
+// Read in the pages of [va, va+n) in p that are swapped out,
+// or still in the executable or a mapped file, so that the
+// kernel can then copy to or from them without taking a page
+// fault that would have to sleep. If heap is set, also
+// allocate heap pages never touched yet, so that the kernel
+// can write to them without a fault that could fail.
+int
+uvmpagein(struct proc *p, uint va, uint n, int heap)
+{
+  pte_t *pte;
+  uint a, last;
+
+  if(n == 0)
+    return 0;
+  last = PGROUNDDOWN(va + n - 1);
+  for(a = PGROUNDDOWN(va); a <= last; a += PGSIZE){
+    if(p->pgdir[PDX(a)] & PTE_PS){
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+      continue;
+    }
+    pte = walkpgdir(p->pgdir, (char*)a, 0);
+    if(pte && (*pte & PTE_P))
+      continue;
+    if(!(pte && (*pte & PTE_SWAP)) && findseg(p, a) == 0 &&
+       findvma(p, a) == 0 && !(heap && a >= PGSIZE && a < p->sz))
+      continue;
+    if(pagein(p, a, 1) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+// Pages read in after a fault in a MADV_SEQUENTIAL range.
+#define READAHEAD 8
+
+// The kernel, in a system call, touched user address va of the
+// current process, and the fault cannot be satisfied. Kill the
+// process, and map va to the scrap page so that the access can
+// complete and the system call unwind; the process then exits
+// before it returns to user space. The scrap page is not
+// user-accessible, never written back, and never freed.
+static void
+killfault(uint va)
+{
+  struct proc *p = myproc();
+  pte_t *pte;
+
+  cprintf("pid %d %s: bad kernel access to addr 0x%x--kill proc\n",
+          p->pid, p->name, va);
+  p->killed = 1;
+  va = PGROUNDDOWN(va);
+  acquire(&vmlock);
+  if((pte = walkpgdir(p->pgdir, (char*)va, 1)) == 0)
+    panic("killfault: out of memory");
+  if(*pte & PTE_SWAP)
+    swapfree(*pte);
+  else if(*pte & PTE_P){
+    rmapdel(p->pgdir, va, PTE_ADDR(*pte));
+    kfree(P2V(PTE_ADDR(*pte)));
+  }
+  *pte = V2P(scrappage) | PTE_P | PTE_W;
+  release(&vmlock);
+  invlpg((void*)va);
+}
+
 void
 page_fault_handler(uint err){
 
@@ -412,9 +814,21 @@ page_fault_handler(uint err){
     return;
   }
 
+  vmcount(VM_FAULT, 1);
   pte = walkpgdir(myproc()->pgdir, (void*)cr2, 0);
-  if(pte == 0){
-    cprintf("pte == 0, it does not exist, error code is %d\n", err);
+  if(pte == 0 || !(*pte & PTE_P)){
+    if(pagein(myproc(), cr2, err & FEC_WR) == 0){
+      // Reading ahead sleeps, which a kernel fault may not.
+      if((err & FEC_U) && readahead(myproc(), cr2))
+        uvmpagein(myproc(), PGROUNDDOWN(cr2) + PGSIZE, READAHEAD*PGSIZE, 0);
+      return;
+    }
+    if(!(err & FEC_U)){
+      killfault(cr2);
+      return;
+    }
+    cprintf("pid %d %s: page fault on unmapped addr 0x%x\n",
+            myproc()->pid, myproc()->name, cr2);
     myproc()->killed = 1;
     return;
   }
@@ -426,6 +840,11 @@ page_fault_handler(uint err){
   }
 
   if( !(*pte & PTE_COW) ){
+    // A system call writing into the program's text, say.
+    if(!(err & FEC_U)){
+      killfault(cr2);
+      return;
+    }
     cprintf("!(*pte & PTE_COW)\n");
     myproc()->killed = 1;
     return;
@@ -437,25 +856,53 @@ page_fault_handler(uint err){
   }
 
   uint pa = PTE_ADDR(*pte);
+  uint va = PGROUNDDOWN(cr2);
   char *mem;
-  uint count_time = get_ref_count(pa);
+  // The zero page keeps no count, but is always shared.
+  uint count_time = pa == V2P(zeropage) ? 2 : get_ref_count(pa);
   if(count_time == 1) {
+    acquire(&vmlock);
     *pte |= PTE_W;
     *pte &= ~PTE_COW;
+    // A text or file page the page cache has let go of is
+    // ours alone now, so it can be swapped like any other.
+    if(!isanon(pa))
+      rmapadd(myproc()->pgdir, va, pa);
+    release(&vmlock);
+    vmcount(VM_COWREUSE, 1);
   }
   else if( count_time >= 2 ){
-    if((mem = kalloc()) == 0){
+    // Hold on to the page, which kalloc_user() might otherwise
+    // swap out from under us.
+    inc_ref_count(pa);
+    if((mem = kalloc_user()) == 0){
+      kfree((char*)P2V(pa));
+      if(!(err & FEC_U)){
+        killfault(cr2);
+        return;
+      }
       cprintf("allocate memory fail!!\n");
       myproc()->killed = 1;
       return;
     }
-    memmove(mem, (char*)P2V(pa), PGSIZE);
+    // kalloc_user() pages are zeroed already.
+    if(pa != V2P(zeropage))
+      memmove(mem, (char*)P2V(pa), PGSIZE);
+    acquire(&vmlock);
+    rmapdel(myproc()->pgdir, va, pa);
     *pte = V2P(mem) | PTE_P | PTE_U | PTE_W;
     *pte &= ~PTE_COW;
-    dec_ref_count(pa);
+    rmapadd(myproc()->pgdir, va, V2P(mem));
+    release(&vmlock);
+    // Drop our references. If the other sharers have dropped
+    // theirs in the meantime, this frees the old page.
+    kfree((char*)P2V(pa));
+    kfree((char*)P2V(pa));
+    vmcount(VM_COWCOPY, 1);
   }else{
     panic("count_time is invalid\n");
   }
-  lcr3(V2P(myproc()->pgdir));
+  // Only this PTE changed, so keep the rest of the TLB.
+  invlpg((void*)va);
 
 }
\ No newline at end of file
@@ -0,0 +1,69 @@
+// Print system-wide memory statistics every interval ticks
+// (100 ticks is about a second), count times, or until killed.
+// The first line shows totals since boot; later lines show
+// rates per second over the last interval.
+//
+//   vmstat [interval [count]]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "vmstat.h"
+
+#define HZ 100   // timer interrupts per second
+
+void
+sample(struct vmstat *vs)
+{
+  if(vmstat(vs) < 0){
+    printf(2, "vmstat: vmstat failed\n");
+    exit();
+  }
+}
+
+// Print one line. The counters are the differences from prev
+// scaled to per second over ticks, or the totals if ticks is 0.
+void
+show(struct vmstat *vs, struct vmstat *prev, int ticks)
+{
+  int c[NVMCOUNT], i;
+
+  for(i = 0; i < NVMCOUNT; i++){
+    c[i] = vs->count[i];
+    if(ticks > 0 && i != VM_PIPES)
+      c[i] = (c[i] - prev->count[i]) * HZ / ticks;
+  }
+  printf(1, "%d %d %d %d %d %d  %d %d  %d %d %d %d %d  %d %d\n",
+         vs->nfree, vs->ntotal - vs->nfree, vs->nzero, vs->npcache,
+         vs->nbuf, c[VM_PIPES], c[VM_ALLOC], c[VM_FREE], c[VM_FAULT],
+         c[VM_ZEROFILL], c[VM_ZEROPAGE], c[VM_FILEFAULT], c[VM_SWAPIN],
+         c[VM_COWCOPY], c[VM_COWREUSE]);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct vmstat vs, prev;
+  int interval, count, i, t, last;
+
+  interval = argc > 1 ? atoi(argv[1]) : HZ;
+  count = argc > 2 ? atoi(argv[2]) : -1;
+  if(interval <= 0){
+    printf(2, "usage: vmstat [interval [count]]\n");
+    exit();
+  }
+
+  printf(1, "free used zero pcache bufs pipes  alloc free  all zfill zpage file swap  copy reuse\n");
+  sample(&vs);
+  show(&vs, 0, 0);
+  last = uptime();
+  for(i = 1; count < 0 || i < count; i++){
+    prev = vs;
+    sleep(interval);
+    sample(&vs);
+    t = uptime();
+    show(&vs, &prev, t > last ? t - last : 1);
+    last = t;
+  }
+  exit();
+}
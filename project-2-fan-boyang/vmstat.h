@@ -0,0 +1,27 @@
+#ifndef _VMSTAT_H_
+#define _VMSTAT_H_
+
+// Memory event counters, kept per CPU and summed by vmstat().
+// Event counts only grow; sample twice and subtract for rates.
+#define VM_ALLOC      0   // pages allocated
+#define VM_FREE       1   // pages freed
+#define VM_FAULT      2   // user page faults, of any kind
+#define VM_ZEROFILL   3   // faults given a fresh zeroed page
+#define VM_ZEROPAGE   4   // read faults mapped to the shared zero page
+#define VM_FILEFAULT  5   // faults on executable or mmap()ed file pages
+#define VM_SWAPIN     6   // faults on pages that were swapped out
+#define VM_COWCOPY    7   // copy-on-write faults that copied the page
+#define VM_COWREUSE   8   // copy-on-write faults on a page no longer shared
+#define VM_PIPES      9   // pipes open: +1 on create, -1 on close
+#define NVMCOUNT      10
+
+struct vmstat {
+  uint ntotal;            // pages managed by the allocator
+  uint nfree;             // free pages, including per-CPU caches
+  uint nzero;             // pre-zeroed pages waiting for kalloc_zeroed()
+  uint npcache;           // pages held by the file page cache
+  uint nbuf;              // buffer cache blocks holding disk data
+  int count[NVMCOUNT];
+};
+
+#endif //_VMSTAT_H_
@@ -130,6 +130,28 @@ xchg(volatile uint *addr, uint newval)
   return result;
 }
 
+// Low 32 bits of the time-stamp counter; enough to time
+// short kernel operations.
+static inline uint
+rdtsc(void)
+{
+  uint lo;
+
+  asm volatile("rdtsc" : "=a" (lo) : : "edx");
+  return lo;
+}
+
+// Atomically add v to *addr; returns the old value.
+static inline ushort
+xaddw(volatile ushort *addr, ushort v)
+{
+  asm volatile("lock; xaddw %0, %1" :
+               "+r" (v), "+m" (*addr) :
+               :
+               "cc", "memory");
+  return v;
+}
+
 static inline uint
 rcr2(void)
 {
@@ -144,6 +166,13 @@ lcr3(uint val)
   asm volatile("movl %0,%%cr3" : : "r" (val));
 }
 
+// Flush the TLB entry for one virtual address.
+static inline void
+invlpg(void *addr)
+{
+  asm volatile("invlpg (%0)" : : "r" (addr) : "memory");
+}
+
 //PAGEBREAK: 36
 // Layout of the trap frame built on the stack by the
 // hardware and by trapasm.S, and passed to trap().
@@ -0,0 +1,63 @@
+// Print the percentage of time each CPU spent idle, every
+// interval ticks (100 ticks is about a second), count times, or
+// until killed. The first line covers the time since boot,
+// later lines the last interval. Also shows how many wakeup
+// IPIs each CPU got in that time.
+//
+//   cpustat [interval [count]]
+
+#include "types.h"
+#include "stat.h"
+#include "param.h"
+#include "user.h"
+#include "pstat.h"
+
+void
+sample(struct cpustat *cs)
+{
+  if(getcpustat(cs) < 0){
+    printf(2, "cpustat: getcpustat failed\n");
+    exit();
+  }
+}
+
+// Print one line: the differences from prev, or the totals if
+// prev is 0.
+void
+show(struct cpustat *cs, struct cpustat *prev)
+{
+  uint ticks, idle, nipi;
+  int i;
+
+  for(i = 0; i < cs->ncpu; i++){
+    ticks = cs->ticks[i] - (prev ? prev->ticks[i] : 0);
+    idle = cs->idle[i] - (prev ? prev->idle[i] : 0);
+    nipi = cs->nipi[i] - (prev ? prev->nipi[i] : 0);
+    printf(1, "cpu%d %d%% idle %d ipi   ", i, ticks ? idle * 100 / ticks : 0, nipi);
+  }
+  printf(1, "\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct cpustat cs, prev;
+  int interval, count, i;
+
+  interval = argc > 1 ? atoi(argv[1]) : 100;
+  count = argc > 2 ? atoi(argv[2]) : -1;
+  if(interval <= 0){
+    printf(2, "usage: cpustat [interval [count]]\n");
+    exit();
+  }
+
+  sample(&cs);
+  show(&cs, 0);
+  for(i = 1; count < 0 || i < count; i++){
+    prev = cs;
+    sleep(interval);
+    sample(&cs);
+    show(&cs, &prev);
+  }
+  exit();
+}
@@ -1,9 +1,11 @@
 struct buf;
 struct context;
+struct cpustat;
 struct file;
 struct inode;
 struct pipe;
 struct proc;
+struct pstat;
 struct rtcdate;
 struct spinlock;
 struct sleeplock;
@@ -86,6 +88,7 @@ extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(void);
 void            lapicstartap(uchar, uint);
+void            lapicipi(uchar, int);
 void            microdelay(int);
 
 // log.c
@@ -121,6 +124,8 @@ void            pinit(void);
 void            procdump(void);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
+void            schedtick(void);
+void            schedwakeup(void);
 void            setproc(struct proc*);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
@@ -131,6 +136,13 @@ int             clone(void(*)(void*), void* arg, void* stack);
 int             join(int);
 void            cv_sleep(void*, lock_t*);
 void            cv_wake(void*);
+int             nice(int);
+void            getpinfo(struct pstat*);
+int             settickets(int, int);
+int             setsched(int);
+int             setaffinity(int, uint);
+int             getaffinity(int);
+void            getcpustat(struct cpustat*);
 
 // swtch.S
 void            swtch(struct context**, struct context*);
@@ -160,6 +160,22 @@ lapicstartap(uchar apicid, uint addr)
   }
 }
 
+// Send interrupt vector to the CPU with the given APIC ID.
+void
+lapicipi(uchar apicid, int vector)
+{
+  // An interrupt handler sending one of its own must not come
+  // between the two writes.
+  if(!lapic)
+    return;
+  pushcli();
+  lapicw(ICRHI, apicid<<24);
+  lapicw(ICRLO, FIXED | ASSERT | vector);
+  while(lapic[ICRLO] & DELIVS)
+    ;
+  popcli();
+}
+
 #define CMOS_STATA   0x0a
 #define CMOS_STATB   0x0b
 #define CMOS_UIP    (1 << 7)        // RTC update in progress
@@ -6,24 +6,148 @@
 #include "x86.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "pstat.h"
+#include "traps.h"
+
+// Locking.
+//
+// Each process has a lock, plock(p), that protects its state,
+// chan and killed fields and its run queue membership. It is
+// held across swtch() between a process and the scheduler: a
+// process acquires it before giving up the CPU, and the
+// scheduler releases it once the process is off its stack.
+// sleep() takes it before releasing the caller's lock, and
+// wakeup() takes it to check for sleepers, so no wakeup is
+// lost.
+//
+// ptable.lock only serializes allocating process slots and
+// changes to p->parent, and makes exit() and wait() agree. It
+// comes before any process lock, which comes before any run
+// queue lock or ticket pool lock. Pool membership changes under
+// ptable.lock; a pool's lock guards its tickets and the count
+// of its active members.
+//
+// A RUNNABLE process waits on exactly one CPU's run queue, or
+// has just been taken off one by a scheduler that will run it.
+// Each CPU takes the next process from the head of its own
+// queue in O(1). A CPU that finds its queue empty steals from
+// the longest other queue, and every BALANCETICKS timer ticks
+// each CPU pulls processes over from a queue at least two
+// longer than its own.
+//
+// A process only ever waits on the queue of a CPU in its
+// affinity mask. Otherwise it goes back to the CPU it last ran
+// on when it wakes or yields, where its cache may still be
+// warm, and balancing leaves alone processes that ran in the
+// last CACHEHOT ticks.
+//
+// A CPU with nothing to run halts until the next interrupt
+// rather than spinning. Queueing a process for a halted CPU, or
+// on a busy CPU while another the process may run on is halted,
+// sends the halted one an IPI, so it does not wait for its next
+// timer tick to start it.
+//
+// Scheduling is a multi-level feedback queue. Each run queue
+// has NLEVEL levels, and the scheduler runs the head of the
+// highest non-empty one. A process starts at level 0 and may
+// run for slicelen[level] ticks there, across any number of
+// sleeps; once it has used them up it moves one level down,
+// and its time slice grows. A process waiting at a higher
+// level than the running one preempts it at the next tick.
+// Every BOOSTTICKS ticks all processes move back up, so that
+// CPU-bound ones are not starved. A process's nice value is
+// the highest level it may reach.
+//
+// setsched() can switch to stride scheduling instead, which
+// shares the CPUs in proportion to tickets. Every process draws
+// its tickets from a pool: its own, or one it shares with the
+// process it was forked or cloned from, in which case the
+// pool's tickets are split among its members that are runnable.
+// A tenant's share thus stays the same however many processes
+// it runs. Each tick a process runs advances its pass by its
+// stride, STRIDE1 divided by its tickets, and each CPU runs the
+// process with the lowest pass. The queues are then kept sorted
+// by pass at level 0, and a CPU takes the lowest of their heads
+// rather than only its own, so the shares hold across CPUs; a
+// process that has been asleep starts again at most one stride
+// past the last pass run, so it neither hoards nor loses time.
+
+#define BALANCETICKS 20
+#define CACHEHOT 2
+#define BOOSTTICKS 100
+#define STRIDE1 (1 << 16)
+#define DEFTICKETS 100
+#define MAXTICKETS 10000
+
+static int slicelen[NLEVEL] = {1, 2, 4, 8};
+static uint boostepoch;        // advanced every BOOSTTICKS by CPU 0
+static int schedpolicy = SCHED_MLFQ;
+static uint stridepass;        // highest pass run so far, in stride mode
+
+struct runq
+{
+  struct spinlock lock;
+  struct proc *head[NLEVEL];   // next to run at each level
+  struct proc *tail[NLEVEL];
+  int n;                       // processes queued; read without the lock
+  uint ticks;                  // timer ticks on this CPU
+  uint idle;                   // of those, ticks with nothing to run
+  uint nipi;                   // wakeup IPIs this CPU took
+  volatile uint halted;        // set while the CPU halts in idle()
+  uint epoch;                  // boostepoch at this queue's last boost
+};
 
 struct
 {
   struct spinlock lock;
   struct proc proc[NPROC];
+  struct spinlock plock[NPROC];
 } ptable;
 
+static struct runq runq[NCPU];
+
+// A ticket pool.
+struct tpool
+{
+  struct spinlock lock;
+  int tickets;                 // split among the active members
+  int share;                   // new children join instead of copying it
+  int nmember;                 // processes in it; 0 if the pool is free
+  int nactive;                 // members RUNNABLE or RUNNING
+};
+
+static struct tpool tpool[NPROC];
+
 static struct proc *initproc;
 
 int nextpid = 1;
 extern void forkret(void);
 extern void trapret(void);
 
-static void wakeup1(void *chan);
+static void makerunnable(struct proc *p, int cpu);
+static int idlestcpu(struct proc *p);
+static void tpooljoin(struct proc *p, struct tpool *from);
+static void tpoolleave(struct proc *p);
+static void tpoolactive(struct proc *p, int n);
 
 void pinit(void)
 {
+  int i;
+
   initlock(&ptable.lock, "ptable");
+  for (i = 0; i < NPROC; i++)
+    initlock(&ptable.plock[i], "proc");
+  for (i = 0; i < NCPU; i++)
+    initlock(&runq[i].lock, "runq");
+  for (i = 0; i < NPROC; i++)
+    initlock(&tpool[i].lock, "tpool");
+}
+
+// The lock of process p.
+static struct spinlock *
+plock(struct proc *p)
+{
+  return &ptable.plock[p - ptable.proc];
 }
 
 // Must be called with interrupts disabled
@@ -90,6 +214,16 @@ allocproc(void)
 found:
   p->state = EMBRYO;
   p->pid = nextpid++;
+  p->nice = 0;
+  p->level = 0;
+  p->slice = slicelen[0];
+  p->epoch = boostepoch;
+  p->resched = 0;
+  memset(p->ticks, 0, sizeof(p->ticks));
+  p->pool = 0;
+  p->pass = 0;
+  p->affinity = ~0;
+  p->lastran = 0;
 
   release(&ptable.lock);
 
@@ -151,10 +285,14 @@ void userinit(void)
   // writes to be visible, and the lock is also needed
   // because the assignment might not be atomic.
   acquire(&ptable.lock);
+  tpooljoin(p, 0);
+  release(&ptable.lock);
 
-  p->state = RUNNABLE;
+  acquire(plock(p));
 
-  release(&ptable.lock);
+  makerunnable(p, 0);
+
+  release(plock(p));
 }
 
 // Grow current process's memory by n bytes.
@@ -244,6 +382,9 @@ int fork(void)
   np->sz = curproc->sz;
   //need initialization
   np->child_thread = 0;
+  np->nice = np->level = curproc->nice;
+  np->slice = slicelen[np->level];
+  np->affinity = curproc->affinity;
   np->parent = curproc;
   *np->tf = *curproc->tf;
 
@@ -260,10 +401,14 @@ int fork(void)
   pid = np->pid;
 
   acquire(&ptable.lock);
+  tpooljoin(np, curproc->pool);
+  release(&ptable.lock);
 
-  np->state = RUNNABLE;
+  acquire(plock(np));
 
-  release(&ptable.lock);
+  makerunnable(np, idlestcpu(np));
+
+  release(plock(np));
 
   return pid;
 }
@@ -298,7 +443,7 @@ void exit(void)
   acquire(&ptable.lock);
 
   // Parent might be sleeping in wait().
-  wakeup1(curproc->parent);
+  wakeup(curproc->parent);
 
   // Pass abandoned children to init.
   if (curproc->child_thread == 0)
@@ -312,31 +457,37 @@ void exit(void)
         {
           p->parent = initproc;
           if (p->state == ZOMBIE)
-            wakeup1(initproc);
+            wakeup(initproc);
         }
         else
         {
           // p->killed = 1;
+          acquire(plock(p));
           if (p->state != ZOMBIE)
           {
             p->killed = 1;
-            if (p->state != RUNNING)
+            if (p->state == SLEEPING)
             {
-              p->state = RUNNABLE;
+              makerunnable(p, p->cpu);
             }
+            release(plock(p));
             sleep(curproc, &ptable.lock); //DOC: wait-sleep
           }
+          else
+            release(plock(p));
         }
       }
     }
   }
 
-  // Jump into the scheduler, never to return.
+  // Jump into the scheduler, never to return. The parent
+  // cannot look at us before ptable.lock is released, by which
+  // time we are a ZOMBIE, and it cannot free us before the
+  // scheduler has released our lock.
+  acquire(plock(curproc));
   curproc->state = ZOMBIE;
-  if (curproc->parent->state == SLEEPING)
-  {
-    wakeup1(curproc->parent);
-  }
+  tpoolactive(curproc, -1);
+  release(&ptable.lock);
   sched();
   panic("zombie exit");
 }
@@ -359,6 +510,7 @@ int wait(void)
       if (p->parent != curproc || p->child_thread == 1)
         continue;
       havekids = 1;
+      acquire(plock(p));
       if (p->state == ZOMBIE)
       {
         // Found one.
@@ -370,10 +522,13 @@ int wait(void)
         p->parent = 0;
         p->name[0] = 0;
         p->killed = 0;
+        tpoolleave(p);
         p->state = UNUSED;
+        release(plock(p));
         release(&ptable.lock);
         return pid;
       }
+      release(plock(p));
     }
 
     // No point waiting if we don't have any children.
@@ -383,16 +538,552 @@ int wait(void)
       return -1;
     }
 
-    // Wait for children to exit.  (See wakeup1 call in proc_exit.)
+    // Wait for children to exit.  (See wakeup call in exit.)
     sleep(curproc, &ptable.lock); //DOC: wait-sleep
   }
 }
 
+//PAGEBREAK: 42
+// Ticket pools.
+
+// Put p in a ticket pool: from, if it is shared, or else a new
+// one with as many tickets as from, or DEFTICKETS if from is 0.
+// Caller must hold ptable.lock.
+static void
+tpooljoin(struct proc *p, struct tpool *from)
+{
+  struct tpool *tp;
+
+  if (from && from->share)
+    tp = from;
+  else
+  {
+    // There are as many pools as process slots, so one is free.
+    for (tp = tpool; tp->nmember > 0; tp++)
+      if (tp == &tpool[NPROC - 1])
+        panic("tpooljoin");
+    tp->tickets = from ? from->tickets : DEFTICKETS;
+    tp->share = 0;
+    tp->nactive = 0;
+  }
+  tp->nmember++;
+  p->pool = tp;
+}
+
+// Take p, which is being freed, out of its pool.
+// Caller must hold ptable.lock.
+static void
+tpoolleave(struct proc *p)
+{
+  if (p->pool)
+    p->pool->nmember--;
+  p->pool = 0;
+}
+
+// Count p in (n = 1) or out (n = -1) of the active members of
+// its pool. Caller must hold p's lock.
+static void
+tpoolactive(struct proc *p, int n)
+{
+  struct tpool *tp = p->pool;
+
+  acquire(&tp->lock);
+  tp->nactive += n;
+  release(&tp->lock);
+}
+
+// How far p's pass advances for each tick it runs.
+static uint
+stride(struct proc *p)
+{
+  struct tpool *tp = p->pool;
+
+  return STRIDE1 * (tp->nactive > 1 ? tp->nactive : 1) / tp->tickets;
+}
+
+// Does pass a come before pass b? Passes wrap around.
+static int
+before(uint a, uint b)
+{
+  return (int)(a - b) < 0;
+}
+
+//PAGEBREAK: 42
+// Run queues. All of these require the queue's lock.
+
+// Queue p at the tail of its level, or in stride mode in order
+// of pass at level 0.
+static void
+runqput(struct runq *rq, struct proc *p)
+{
+  struct proc **pp;
+  int l = p->level;
+
+  if (schedpolicy == SCHED_STRIDE)
+  {
+    for (pp = &rq->head[0]; *pp && !before(p->pass, (*pp)->pass); pp = &(*pp)->rqnext)
+      ;
+    p->rqnext = *pp;
+    *pp = p;
+    if (p->rqnext == 0)
+      rq->tail[0] = p;
+    rq->n++;
+    return;
+  }
+  p->rqnext = 0;
+  if (rq->tail[l])
+    rq->tail[l]->rqnext = p;
+  else
+    rq->head[l] = p;
+  rq->tail[l] = p;
+  rq->n++;
+}
+
+static struct proc *
+runqpop(struct runq *rq, int l)
+{
+  struct proc *p;
+
+  if ((p = rq->head[l]) == 0)
+    return 0;
+  rq->head[l] = p->rqnext;
+  if (rq->head[l] == 0)
+    rq->tail[l] = 0;
+  rq->n--;
+  return p;
+}
+
+// Take the process that should run next: the one that has
+// waited longest at the highest non-empty level.
+static struct proc *
+runqget(struct runq *rq)
+{
+  int l;
+
+  for (l = 0; l < NLEVEL; l++)
+    if (rq->head[l])
+      return runqpop(rq, l);
+  return 0;
+}
+
+// Take p off rq. Returns 0 if it is not there.
+static int
+runqremove(struct runq *rq, struct proc *p)
+{
+  struct proc **pp, *prev;
+  int l;
+
+  for (l = 0; l < NLEVEL; l++)
+  {
+    prev = 0;
+    for (pp = &rq->head[l]; *pp; pp = &(*pp)->rqnext)
+    {
+      if (*pp == p)
+      {
+        *pp = p->rqnext;
+        if (rq->tail[l] == p)
+          rq->tail[l] = prev;
+        rq->n--;
+        return 1;
+      }
+      prev = *pp;
+    }
+  }
+  return 0;
+}
+
+// May p run on cpu?
+static int
+cpuok(struct proc *p, int cpu)
+{
+  return (p->affinity >> cpu) & 1;
+}
+
+// Has p run so recently that its cache is likely still warm?
+static int
+cachehot(struct proc *p)
+{
+  return ticks - p->lastran < CACHEHOT;
+}
+
+// Take a process to move to CPU to: the one nearest the tail of
+// the lowest non-empty level, a CPU-bound one that has waited
+// least, and so has the least claim to this CPU's cache. Only
+// takes one that may run on to, and if cold is set one that is
+// not cache-hot.
+static struct proc *
+runqtake(struct runq *rq, int to, int cold)
+{
+  struct proc *p, *last;
+  int l;
+
+  for (l = NLEVEL - 1; l >= 0; l--)
+  {
+    last = 0;
+    for (p = rq->head[l]; p; p = p->rqnext)
+      if (cpuok(p, to) && !(cold && cachehot(p)))
+        last = p;
+    if (last)
+    {
+      runqremove(rq, last);
+      return last;
+    }
+  }
+  return 0;
+}
+
+// The process runqget() would take, or 0.
+// Reads the queue without the lock.
+static struct proc *
+runqhead(struct runq *rq)
+{
+  int l;
+
+  for (l = 0; l < NLEVEL; l++)
+    if (rq->head[l])
+      return rq->head[l];
+  return 0;
+}
+
+// The highest level with a process waiting, or NLEVEL.
+// Reads the queue without the lock.
+static int
+runqtop(struct runq *rq)
+{
+  int l;
+
+  for (l = 0; l < NLEVEL && rq->head[l] == 0; l++)
+    ;
+  return l;
+}
+
+// Move p back up to the top level it may reach, with a fresh
+// time slice, if a boost has happened since it last moved.
+static void
+boost(struct proc *p)
+{
+  if (p->epoch == boostepoch)
+    return;
+  p->epoch = boostepoch;
+  p->level = p->nice;
+  p->slice = slicelen[p->level];
+}
+
+// Boost every process on rq, and queue it again as the current
+// policy wants.
+static void
+runqboost(struct runq *rq)
+{
+  struct proc *list, *p;
+  int l;
+
+  acquire(&rq->lock);
+  list = 0;
+  for (l = 0; l < NLEVEL; l++)
+  {
+    while ((p = runqpop(rq, l)) != 0)
+    {
+      p->rqnext = list;
+      list = p;
+    }
+  }
+  while ((p = list) != 0)
+  {
+    list = p->rqnext;
+    boost(p);
+    runqput(rq, p);
+  }
+  rq->epoch = boostepoch;
+  release(&rq->lock);
+}
+
+// p has just been queued on cpu's run queue: wake cpu with an
+// IPI if it is halted, or if it is busy another halted CPU that
+// p may run on, which will then steal it. A process that yields
+// is left to this CPU, which is about to schedule anyway.
+static void
+kick(struct proc *p, int cpu)
+{
+  int i;
+
+  if (p == myproc())
+    return;
+  if (!runq[cpu].halted)
+  {
+    for (i = 0; i < ncpu; i++)
+      if (runq[i].halted && cpuok(p, i))
+        break;
+    if (i == ncpu)
+      return;
+    cpu = i;
+  }
+  lapicipi(cpus[cpu].apicid, T_IRQ0 + IRQ_WAKEUP);
+}
+
+// Queue p on the run queue of cpu, or of another CPU if p may
+// not run on cpu. Caller must hold p's lock.
+static void
+enqueue(struct proc *p, int cpu)
+{
+  struct runq *rq;
+
+  if (!cpuok(p, cpu))
+    cpu = idlestcpu(p);
+  rq = &runq[cpu];
+  p->cpu = cpu;
+  acquire(&rq->lock);
+  runqput(rq, p);
+  release(&rq->lock);
+  kick(p, cpu);
+}
+
+// Mark p RUNNABLE and queue it on the run queue of cpu, if it
+// may run there. Caller must hold p's lock.
+static void
+makerunnable(struct proc *p, int cpu)
+{
+  if (p->state != RUNNING)
+  {
+    tpoolactive(p, 1);
+    if (before(p->pass, stridepass))
+      p->pass = stridepass;
+    if (p->pass - stridepass > stride(p))
+      p->pass = stridepass + stride(p);
+  }
+  p->state = RUNNABLE;
+  boost(p);
+  enqueue(p, cpu);
+}
+
+// The CPU with the shortest run queue of those p may run on,
+// for a new process.
+static int
+idlestcpu(struct proc *p)
+{
+  int i, best;
+
+  best = -1;
+  for (i = 0; i < ncpu; i++)
+    if (cpuok(p, i) && (best < 0 || runq[i].n < runq[best].n))
+      best = i;
+  return best < 0 ? 0 : best;
+}
+
+// The CPU other than me with the longest run queue, or -1 if
+// all of them are empty.
+static int
+busiestcpu(int me)
+{
+  int i, best;
+
+  best = -1;
+  for (i = 0; i < ncpu; i++)
+    if (i != me && runq[i].n > 0 && (best < 0 || runq[i].n > runq[best].n))
+      best = i;
+  return best;
+}
+
+// Move up to n processes that are not cache-hot from the tail
+// of from's queue to to's. Takes both queue locks, lower CPU
+// first.
+static int
+migrate(int from, int to, int n)
+{
+  struct runq *a, *b;
+  struct proc *p;
+  int moved;
+
+  a = &runq[from < to ? from : to];
+  b = &runq[from < to ? to : from];
+  acquire(&a->lock);
+  acquire(&b->lock);
+  for (moved = 0; moved < n; moved++)
+  {
+    if ((p = runqtake(&runq[from], to, 1)) == 0)
+      break;
+    p->cpu = to;
+    runqput(&runq[to], p);
+  }
+  release(&b->lock);
+  release(&a->lock);
+  return moved;
+}
+
+// Called by an idle CPU: take the newest process of the
+// busiest other CPU, if possible one that is not cache-hot.
+static struct proc *
+steal(int me)
+{
+  struct runq *rq;
+  struct proc *p;
+  int victim;
+
+  if ((victim = busiestcpu(me)) < 0)
+    return 0;
+  rq = &runq[victim];
+  acquire(&rq->lock);
+  if ((p = runqtake(rq, me, 1)) == 0)
+    p = runqtake(rq, me, 0);
+  release(&rq->lock);
+  return p;
+}
+
+// In stride mode: the CPU whose run queue has the process with
+// the lowest pass at its head of those that may run on me,
+// preferring me on ties, or -1 if there is none. Sets *headp
+// to that process. Reads the queues without their locks.
+static int
+stridecpu(int me, struct proc **headp)
+{
+  struct proc *p;
+  int i, cpu, best;
+
+  best = -1;
+  *headp = 0;
+  for (i = 0; i < ncpu; i++)
+  {
+    cpu = (me + i) % ncpu;
+    if ((p = runqhead(&runq[cpu])) != 0 && cpuok(p, me) &&
+        (*headp == 0 || before(p->pass, (*headp)->pass)))
+    {
+      best = cpu;
+      *headp = p;
+    }
+  }
+  return best;
+}
+
+// In stride mode: take the process with the lowest pass of all
+// the run queues.
+static struct proc *
+stridepick(int me)
+{
+  struct proc *p;
+  int cpu;
+
+  if ((cpu = stridecpu(me, &p)) < 0)
+    return 0;
+  acquire(&runq[cpu].lock);
+  if ((p = runqhead(&runq[cpu])) != 0 && cpuok(p, me))
+    p = runqget(&runq[cpu]);
+  else
+    p = 0;
+  release(&runq[cpu].lock);
+  return p;
+}
+
+// Called on every timer interrupt on every CPU. Charges the
+// tick to the running process and asks it to yield if its time
+// slice is used up or a higher level is waiting, or in stride
+// mode if a process with a lower pass is waiting. Every
+// BALANCETICKS ticks, evens out this CPU's queue with the
+// busiest one, which stride mode has no need for.
+void schedtick(void)
+{
+  struct proc *p, *next;
+  int me, busiest, diff;
+  uint t;
+
+  me = cpuid();
+  t = ++runq[me].ticks;
+  if (mycpu()->proc == 0)
+    runq[me].idle++;
+  if (me == 0 && t % BOOSTTICKS == 0)
+    boostepoch++;
+  if (runq[me].epoch != boostepoch)
+    runqboost(&runq[me]);
+
+  if ((p = mycpu()->proc) != 0 && p->state == RUNNING && schedpolicy == SCHED_STRIDE)
+  {
+    p->ticks[p->level]++;
+    p->pass += stride(p);
+    if (stridecpu(me, &next) >= 0 && before(next->pass, p->pass))
+      p->resched = 1;
+  }
+  else if (p != 0 && p->state == RUNNING)
+  {
+    boost(p);
+    p->ticks[p->level]++;
+    if (--p->slice <= 0)
+    {
+      if (p->level < NLEVEL - 1)
+        p->level++;
+      p->slice = slicelen[p->level];
+      p->resched = 1;
+    }
+    if (runqtop(&runq[me]) < p->level)
+      p->resched = 1;
+  }
+
+  if (schedpolicy == SCHED_STRIDE || t % BALANCETICKS != 0)
+    return;
+  if ((busiest = busiestcpu(me)) < 0)
+    return;
+  diff = runq[busiest].n - runq[me].n;
+  if (diff >= 2)
+    migrate(busiest, me, diff / 2);
+}
+
+// Called on a wakeup IPI. Counted here, by the CPU it woke with
+// interrupts off, as several CPUs may send one at once.
+void schedwakeup(void)
+{
+  runq[cpuid()].nipi++;
+}
+
+// Is there a process queued that CPU me could take? Besides its
+// own queue, in stride mode the head of another one that may
+// run on me, as stridepick() takes, or otherwise any process
+// on another queue that steal() could take.
+static int
+haswork(int me)
+{
+  struct proc *p;
+  int i, l, found;
+
+  if (runq[me].n > 0)
+    return 1;
+  if (schedpolicy == SCHED_STRIDE)
+    return stridecpu(me, &p) >= 0;
+  found = 0;
+  for (i = 0; i < ncpu && !found; i++)
+  {
+    if (i == me || runq[i].n == 0)
+      continue;
+    acquire(&runq[i].lock);
+    for (l = 0; l < NLEVEL && !found; l++)
+      for (p = runq[i].head[l]; p && !found; p = p->rqnext)
+        found = cpuok(p, me);
+    release(&runq[i].lock);
+  }
+  return found;
+}
+
+// Called by the scheduler of CPU me when it found nothing to
+// run: halt until an interrupt. Setting halted with xchg(), a
+// full barrier, before looking at every queue we may take from
+// once more means that whoever queues a process we could run
+// either sees the flag and sends an IPI, to us or another
+// halted CPU, or queued it before we look.
+static void
+idle(int me)
+{
+  struct runq *rq = &runq[me];
+
+  cli();
+  xchg(&rq->halted, 1);
+  if (!haswork(me))
+    stihlt();
+  rq->halted = 0;
+  sti();
+}
+
 //PAGEBREAK: 42
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
-//  - choose a process to run
+//  - take a process from this CPU's run queue, or steal one,
+//    or halt until an interrupt if there is none
 //  - swtch to start running that process
 //  - eventually that process transfers control
 //      via swtch back to the scheduler.
@@ -400,6 +1091,8 @@ void scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int me = c - cpus;
+  struct runq *rq = &runq[me];
   c->proc = 0;
 
   for (;;)
@@ -407,17 +1100,38 @@ void scheduler(void)
     // Enable interrupts on this processor.
     sti();
 
-    // Loop over process table looking for process to run.
-    acquire(&ptable.lock);
-    for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if (schedpolicy == SCHED_STRIDE)
+      p = stridepick(me);
+    else
     {
-      if (p->state != RUNNABLE)
-        continue;
+      acquire(&rq->lock);
+      p = runqget(rq);
+      release(&rq->lock);
+      if (p == 0)
+        p = steal(me);
+    }
+    if (p == 0)
+    {
+      idle(me);
+      continue;
+    }
 
-      // Switch to chosen process.  It is the process's job
-      // to release ptable.lock and then reacquire it
-      // before jumping back to us.
+    // Switch to chosen process.  It is the process's job
+    // to release its lock and then reacquire it
+    // before jumping back to us. The lock may still be
+    // held by the CPU the process just left.
+    acquire(plock(p));
+    if (p->state == RUNNABLE && !cpuok(p, me))
+    {
+      // Its affinity changed after we took it.
+      enqueue(p, p->cpu);
+    }
+    else if (p->state == RUNNABLE)
+    {
       c->proc = p;
+      p->cpu = me;
+      if (before(stridepass, p->pass))
+        stridepass = p->pass;
       switchuvm(p);
       p->state = RUNNING;
 
@@ -428,11 +1142,11 @@ void scheduler(void)
       // It should have changed its p->state before coming back.
       c->proc = 0;
     }
-    release(&ptable.lock);
+    release(plock(p));
   }
 }
 
-// Enter scheduler.  Must hold only ptable.lock
+// Enter scheduler.  Must hold only the process's lock
 // and have changed proc->state. Saves and restores
 // intena because intena is a property of this
 // kernel thread, not this CPU. It should
@@ -444,8 +1158,8 @@ void sched(void)
   int intena;
   struct proc *p = myproc();
 
-  if (!holding(&ptable.lock))
-    panic("sched ptable.lock");
+  if (!holding(plock(p)))
+    panic("sched proc lock");
   if (mycpu()->ncli != 1)
     panic("sched locks");
   if (p->state == RUNNING)
@@ -453,6 +1167,7 @@ void sched(void)
   if (readeflags() & FL_IF)
     panic("sched interruptible");
   intena = mycpu()->intena;
+  p->lastran = ticks;
   swtch(&p->context, mycpu()->scheduler);
   mycpu()->intena = intena;
 }
@@ -460,10 +1175,13 @@ void sched(void)
 // Give up the CPU for one scheduling round.
 void yield(void)
 {
-  acquire(&ptable.lock); //DOC: yieldlock
-  myproc()->state = RUNNABLE;
+  struct proc *p = myproc();
+
+  acquire(plock(p)); //DOC: yieldlock
+  p->resched = 0;
+  makerunnable(p, cpuid());
   sched();
-  release(&ptable.lock);
+  release(plock(p));
 }
 
 // A fork child's very first scheduling by scheduler()
@@ -471,8 +1189,8 @@ void yield(void)
 void forkret(void)
 {
   static int first = 1;
-  // Still holding ptable.lock from scheduler.
-  release(&ptable.lock);
+  // Still holding our lock from scheduler.
+  release(plock(myproc()));
 
   if (first)
   {
@@ -499,20 +1217,19 @@ void sleep(void *chan, struct spinlock *lk)
   if (lk == 0)
     panic("sleep without lk");
 
-  // Must acquire ptable.lock in order to
+  // Must acquire our lock in order to
   // change p->state and then call sched.
-  // Once we hold ptable.lock, we can be
+  // Once we hold it, we can be
   // guaranteed that we won't miss any wakeup
-  // (wakeup runs with ptable.lock locked),
+  // (wakeup takes it to look at us),
   // so it's okay to release lk.
-  if (lk != &ptable.lock)
-  {                        //DOC: sleeplock0
-    acquire(&ptable.lock); //DOC: sleeplock1
-    release(lk);
-  }
+  acquire(plock(p)); //DOC: sleeplock1
+  release(lk);
+
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  tpoolactive(p, -1);
 
   sched();
 
@@ -520,11 +1237,8 @@ void sleep(void *chan, struct spinlock *lk)
   p->chan = 0;
 
   // Reacquire original lock.
-  if (lk != &ptable.lock)
-  { //DOC: sleeplock2
-    release(&ptable.lock);
-    acquire(lk);
-  }
+  release(plock(p)); //DOC: sleeplock2
+  acquire(lk);
 }
 void cv_sleep(void *chan, lock_t *lock)
 {
@@ -533,11 +1247,12 @@ void cv_sleep(void *chan, lock_t *lock)
   if (p == 0)
     panic("sleep");
 
-  acquire(&ptable.lock);
+  acquire(plock(p));
 
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  tpoolactive(p, -1);
   lock->flag = 0;
 
   sched();
@@ -547,7 +1262,7 @@ void cv_sleep(void *chan, lock_t *lock)
 
   // Reacquire original lock.
   // cprintf("cv_sleep before release\n");
-  release(&ptable.lock);
+  release(plock(p));
   // cprintf("cv_sleep after release\n");
   while (xchg(&lock->flag, 1) != 0)
     ;
@@ -555,42 +1270,24 @@ void cv_sleep(void *chan, lock_t *lock)
 
 void cv_wake(void *chan)
 {
-  acquire(&ptable.lock);
-  struct proc *p;
-
-  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if (p->state == SLEEPING && p->chan == chan)
-    {
-      p->state = RUNNABLE;
-      // cprintf("cv_wake before release -- break\n");
-      // release(&ptable.lock);
-      // cprintf("cv_wake after release -- break\n");
-      //break;
-    }
-  // cprintf("cv_wake before release\n");
-  release(&ptable.lock);
-  // cprintf("cv_wake after release\n");
+  wakeup(chan);
 }
 
 //PAGEBREAK!
-// Wake up all processes sleeping on chan.
-// The ptable lock must be held.
-static void
-wakeup1(void *chan)
+// Wake up all processes sleeping on chan, each onto the
+// run queue of the CPU it last ran on.
+// The caller must not hold any process lock.
+void wakeup(void *chan)
 {
   struct proc *p;
 
   for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  {
+    acquire(plock(p));
     if (p->state == SLEEPING && p->chan == chan)
-      p->state = RUNNABLE;
-}
-
-// Wake up all processes sleeping on chan.
-void wakeup(void *chan)
-{
-  acquire(&ptable.lock);
-  wakeup1(chan);
-  release(&ptable.lock);
+      makerunnable(p, p->cpu);
+    release(plock(p));
+  }
 }
 
 // Kill the process with the given pid.
@@ -600,20 +1297,20 @@ int kill(int pid)
 {
   struct proc *p;
 
-  acquire(&ptable.lock);
   for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
   {
+    acquire(plock(p));
     if (p->pid == pid)
     {
       p->killed = 1;
       // Wake process from sleep if necessary.
       if (p->state == SLEEPING)
-        p->state = RUNNABLE;
-      release(&ptable.lock);
+        makerunnable(p, p->cpu);
+      release(plock(p));
       return 0;
     }
+    release(plock(p));
   }
-  release(&ptable.lock);
   return -1;
 }
 
@@ -683,6 +1380,9 @@ int clone(void (*fcn)(void *), void *arg, void *stack)
   np->pgdir = curproc->pgdir;
   np->child_thread = 1;
   np->sz = curproc->sz;
+  np->nice = np->level = curproc->nice;
+  np->slice = slicelen[np->level];
+  np->affinity = curproc->affinity;
 
   if (curproc->child_thread == 0)
   {
@@ -720,8 +1420,12 @@ int clone(void (*fcn)(void *), void *arg, void *stack)
   np->tf->esp = (int)stack + 4096 - 8;
 
   acquire(&ptable.lock);
-  np->state = RUNNABLE;
+  tpooljoin(np, curproc->pool);
   release(&ptable.lock);
+
+  acquire(plock(np));
+  makerunnable(np, idlestcpu(np));
+  release(plock(np));
   return pid;
 }
 
@@ -743,13 +1447,15 @@ int join(int pid)
       if (p->pid != pid)
         continue;
 
-      if (p->child_thread == 0)
-        return -1;
-      if (p->pgdir != curproc->pgdir)
+      if (p->child_thread == 0 || p->pgdir != curproc->pgdir)
+      {
+        release(&ptable.lock);
         return -1;
+      }
 
       havekids = 1;
 
+      acquire(plock(p));
       if (p->state == ZOMBIE)
       {
         // Found one.
@@ -761,10 +1467,13 @@ int join(int pid)
         p->parent = 0;
         p->name[0] = 0;
         p->killed = 0;
+        tpoolleave(p);
         p->state = UNUSED;
+        release(plock(p));
         release(&ptable.lock);
         return repid;
       }
+      release(plock(p));
     }
 
     // No point waiting if we don't have any children.
@@ -774,7 +1483,183 @@ int join(int pid)
       return -1;
     }
 
-    // Wait for children to exit.  (See wakeup1 call in proc_exit.)
+    // Wait for children to exit.  (See wakeup call in exit.)
     sleep(curproc, &ptable.lock); //DOC: wait-sleep
   }
 }
+
+// Lower the current process's priority by incr levels, or raise
+// it if incr is negative, within 0 to NLEVEL-1: the process will
+// not be scheduled above level nice. Returns the new nice value.
+int nice(int incr)
+{
+  struct proc *p = myproc();
+  int n;
+
+  n = p->nice + incr;
+  if (n < 0)
+    n = 0;
+  if (n > NLEVEL - 1)
+    n = NLEVEL - 1;
+  acquire(plock(p));
+  p->nice = n;
+  if (p->level < n)
+  {
+    p->level = n;
+    p->slice = slicelen[n];
+  }
+  release(plock(p));
+  return n;
+}
+
+// Fill in ps with the scheduling state and ticks per level of
+// every process.
+void getpinfo(struct pstat *ps)
+{
+  struct proc *p;
+  int i, l;
+
+  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  {
+    i = p - ptable.proc;
+    acquire(plock(p));
+    ps->inuse[i] = p->state != UNUSED;
+    ps->pid[i] = p->pid;
+    ps->level[i] = p->level;
+    ps->nice[i] = p->nice;
+    ps->tickets[i] = p->pool ? p->pool->tickets : 0;
+    ps->cpu[i] = p->cpu;
+    for (l = 0; l < NLEVEL; l++)
+      ps->ticks[i][l] = p->ticks[l];
+    release(plock(p));
+  }
+}
+
+// Give the current process's ticket pool tickets tickets, from
+// 1 to MAXTICKETS. If share is set, children and threads it
+// creates from now on join the pool and split its tickets with
+// the other members that are runnable; otherwise each gets a
+// pool of its own with as many tickets. Returns 0, or -1 if
+// tickets is out of range.
+int settickets(int tickets, int share)
+{
+  struct tpool *tp = myproc()->pool;
+
+  if (tickets < 1 || tickets > MAXTICKETS)
+    return -1;
+  acquire(&tp->lock);
+  tp->tickets = tickets;
+  tp->share = share != 0;
+  release(&tp->lock);
+  return 0;
+}
+
+// Switch to scheduling policy SCHED_MLFQ or SCHED_STRIDE.
+// Switching to stride scheduling starts every process afresh
+// at the same pass. Returns the old policy, or -1 if policy is
+// unknown.
+int setsched(int policy)
+{
+  struct proc *p;
+  int old, i;
+
+  if (policy != SCHED_MLFQ && policy != SCHED_STRIDE)
+    return -1;
+  old = schedpolicy;
+  if (policy == SCHED_STRIDE && old != SCHED_STRIDE)
+  {
+    for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    {
+      acquire(plock(p));
+      p->pass = stridepass;
+      release(plock(p));
+    }
+  }
+  schedpolicy = policy;
+  for (i = 0; i < ncpu; i++)
+    runqboost(&runq[i]);
+  return old;
+}
+
+// Let the process with the given pid, or the current process
+// if pid is 0, run only on the CPUs whose bits are set in mask.
+// Moves it off a CPU it may no longer run on. Returns 0, or -1
+// if there is no such process or mask names no CPU.
+int setaffinity(int pid, uint mask)
+{
+  struct proc *p, *curproc = myproc();
+  struct runq *rq;
+  int found;
+
+  mask &= (1 << ncpu) - 1;
+  if (mask == 0)
+    return -1;
+  if (pid == 0)
+    pid = curproc->pid;
+  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  {
+    acquire(plock(p));
+    if (p->pid == pid && p->state != UNUSED)
+    {
+      p->affinity = mask;
+      if (p->state == RUNNABLE && !cpuok(p, p->cpu))
+      {
+        // If it is not on the queue, a scheduler has just taken
+        // it, and will move it on instead of running it.
+        rq = &runq[p->cpu];
+        acquire(&rq->lock);
+        found = runqremove(rq, p);
+        release(&rq->lock);
+        if (found)
+          enqueue(p, p->cpu);
+      }
+      else if (p->state == RUNNING && !cpuok(p, p->cpu))
+        p->resched = 1;
+      release(plock(p));
+      if (p == curproc && p->resched)
+        yield();
+      return 0;
+    }
+    release(plock(p));
+  }
+  return -1;
+}
+
+// The affinity mask of the process with the given pid, or the
+// current process if pid is 0, or -1 if there is no such
+// process.
+int getaffinity(int pid)
+{
+  struct proc *p;
+  int mask;
+
+  if (pid == 0)
+    pid = myproc()->pid;
+  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  {
+    acquire(plock(p));
+    if (p->pid == pid && p->state != UNUSED)
+    {
+      mask = p->affinity & ((1 << ncpu) - 1);
+      release(plock(p));
+      return mask;
+    }
+    release(plock(p));
+  }
+  return -1;
+}
+
+// Fill in cs with the ticks every CPU has had, and how many of
+// them it spent idle.
+void getcpustat(struct cpustat *cs)
+{
+  int i;
+
+  cs->ncpu = ncpu;
+  for (i = 0; i < ncpu; i++)
+  {
+    cs->ticks[i] = runq[i].ticks;
+    cs->idle[i] = runq[i].idle;
+    cs->nipi[i] = runq[i].nipi;
+  }
+}
@@ -51,6 +51,18 @@ struct proc {
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
   int child_thread;            // Indicate if the thread is a child thread, 0 mean main thread, while 1 means the main thread
+  struct proc *rqnext;         // Next on the run queue
+  int cpu;                     // CPU whose run queue it is on, or last ran on
+  int level;                   // Feedback queue level, 0 highest
+  int nice;                    // Highest level it may be scheduled at
+  int slice;                   // Ticks left at this level
+  uint epoch;                  // Priority boost it has seen last
+  int resched;                 // Should yield at the end of this trap
+  uint ticks[NLEVEL];          // Timer ticks spent running at each level
+  struct tpool *pool;          // Ticket pool, for stride scheduling
+  uint pass;                   // Stride scheduling virtual time
+  uint affinity;               // CPUs it may run on, one bit each
+  uint lastran;                // ticks when it last gave up a CPU
 };
 
 // Process memory is laid out contiguously, low addresses first:
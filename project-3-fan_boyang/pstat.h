@@ -0,0 +1,28 @@
+#ifndef _PSTAT_H_
+#define _PSTAT_H_
+
+// Scheduling policies, for setsched().
+#define SCHED_MLFQ   0   // multi-level feedback queue
+#define SCHED_STRIDE 1   // CPU shares in proportion to tickets
+
+// Scheduler state of every process table slot, from getpinfo().
+// Include param.h first.
+struct pstat {
+  int inuse[NPROC];          // whether the slot is in use
+  int pid[NPROC];
+  int level[NPROC];          // current feedback queue level, 0 highest
+  int nice[NPROC];           // highest level it may run at
+  int tickets[NPROC];        // tickets of its pool
+  int cpu[NPROC];            // CPU it is queued on or last ran on
+  int ticks[NPROC][NLEVEL];  // timer ticks spent running at each level
+};
+
+// Time spent by every CPU, from getcpustat().
+struct cpustat {
+  int ncpu;
+  uint ticks[NCPU];          // timer ticks on the CPU
+  uint idle[NCPU];           // of those, ticks with nothing to run
+  uint nipi[NCPU];           // wakeup IPIs it took
+};
+
+#endif //_PSTAT_H_
@@ -107,6 +107,13 @@ extern int sys_clone(void);
 extern int sys_join(void);
 extern int sys_cvsleep(void);
 extern int sys_cvwake(void);
+extern int sys_nice(void);
+extern int sys_getpinfo(void);
+extern int sys_settickets(void);
+extern int sys_setsched(void);
+extern int sys_setaffinity(void);
+extern int sys_getaffinity(void);
+extern int sys_getcpustat(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -134,6 +141,13 @@ static int (*syscalls[])(void) = {
 [SYS_join]    sys_join,
 [SYS_cvsleep]   sys_cvsleep,
 [SYS_cvwake]    sys_cvwake,
+[SYS_nice]      sys_nice,
+[SYS_getpinfo]  sys_getpinfo,
+[SYS_settickets] sys_settickets,
+[SYS_setsched]  sys_setsched,
+[SYS_setaffinity] sys_setaffinity,
+[SYS_getaffinity] sys_getaffinity,
+[SYS_getcpustat] sys_getcpustat,
 };
 
 void
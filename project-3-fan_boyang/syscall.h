@@ -23,4 +23,11 @@
 #define SYS_clone  22
 #define SYS_join   23
 #define SYS_cvsleep  24
-#define SYS_cvwake   25
\ No newline at end of file
+#define SYS_cvwake   25
+#define SYS_nice     26
+#define SYS_getpinfo 27
+#define SYS_settickets 28
+#define SYS_setsched 29
+#define SYS_setaffinity 30
+#define SYS_getaffinity 31
+#define SYS_getcpustat 32
\ No newline at end of file
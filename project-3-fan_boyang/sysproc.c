@@ -6,6 +6,7 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "pstat.h"
 
 struct
 {
@@ -154,4 +155,76 @@ sys_cvwake(void){
     return -1;
   cv_wake(cv);
   return 0;
-}
\ No newline at end of file
+}
+
+int
+sys_nice(void)
+{
+  int incr;
+
+  if(argint(0, &incr) < 0)
+    return -1;
+  return nice(incr);
+}
+
+int
+sys_getpinfo(void)
+{
+  struct pstat *ps;
+
+  if(argptr(0, (void *)&ps, sizeof(*ps)) < 0)
+    return -1;
+  getpinfo(ps);
+  return 0;
+}
+
+int
+sys_settickets(void)
+{
+  int tickets, share;
+
+  if(argint(0, &tickets) < 0 || argint(1, &share) < 0)
+    return -1;
+  return settickets(tickets, share);
+}
+
+int
+sys_setsched(void)
+{
+  int policy;
+
+  if(argint(0, &policy) < 0)
+    return -1;
+  return setsched(policy);
+}
+
+int
+sys_setaffinity(void)
+{
+  int pid, mask;
+
+  if(argint(0, &pid) < 0 || argint(1, &mask) < 0)
+    return -1;
+  return setaffinity(pid, mask);
+}
+
+int
+sys_getaffinity(void)
+{
+  int pid;
+
+  if(argint(0, &pid) < 0)
+    return -1;
+  return getaffinity(pid);
+}
+
+int
+sys_getcpustat(void)
+{
+  struct cpustat *cs;
+
+  if(argptr(0, (void *)&cs, sizeof(*cs)) < 0)
+    return -1;
+  getcpustat(cs);
+  return 0;
+}
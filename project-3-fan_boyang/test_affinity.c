@@ -0,0 +1,97 @@
+#include "types.h"
+#include "stat.h"
+#include "param.h"
+#include "user.h"
+#include "pstat.h"
+
+// Pins CPU-bound spinners to the last CPU, one of them by
+// itself and the others from here, next to a spinner that may
+// run anywhere, and checks every few ticks that the pinned ones
+// are never queued on or run by another CPU.
+
+#define NSPIN 3
+#define NSAMPLE 100
+
+void spin(void)
+{
+  volatile int i;
+
+  for (;;)
+    for (i = 0; i < 1000000; i++)
+      ;
+}
+
+int find(struct pstat *ps, int pid)
+{
+  int i;
+
+  for (i = 0; i < NPROC; i++)
+    if (ps->inuse[i] && ps->pid[i] == pid)
+      return i;
+  return -1;
+}
+
+int main(int argc, char *argv[])
+{
+  struct pstat ps;
+  int pids[NSPIN + 1], all, last, mask, i, j, k, n, ok;
+
+  ok = 1;
+  all = getaffinity(0);
+  for (last = 0; (all >> (last + 1)) != 0; last++)
+    ;
+  mask = 1 << last;
+  printf(1, "test_affinity: CPUs 0x%x, pinning to CPU %d\n", all, last);
+  if (setaffinity(0, 0) != -1 || getaffinity(-1) != -1)
+  {
+    printf(1, "test_affinity: bad arguments accepted\n");
+    ok = 0;
+  }
+
+  n = 0;
+  for (i = 0; i < NSPIN + 1; i++)
+  {
+    if ((pids[n] = fork()) < 0)
+    {
+      printf(1, "test_affinity: fork failed\n");
+      break;
+    }
+    if (pids[n] == 0)
+    {
+      if (i == 0)
+        setaffinity(0, mask);
+      spin();
+    }
+    if (i > 0 && i < NSPIN)
+      setaffinity(pids[n], mask);
+    n++;
+  }
+
+  // Let the first child pin itself.
+  sleep(2);
+  for (k = 0; k < NSAMPLE && ok; k++)
+  {
+    getpinfo(&ps);
+    for (i = 0; i < n && i < NSPIN; i++)
+    {
+      if (getaffinity(pids[i]) != mask)
+      {
+        printf(1, "test_affinity: pid %d has mask 0x%x\n", pids[i], getaffinity(pids[i]));
+        ok = 0;
+      }
+      if ((j = find(&ps, pids[i])) >= 0 && ps.cpu[j] != last)
+      {
+        printf(1, "test_affinity: pid %d on CPU %d\n", pids[i], ps.cpu[j]);
+        ok = 0;
+      }
+    }
+    sleep(1);
+  }
+
+  for (i = 0; i < n; i++)
+    kill(pids[i]);
+  for (i = 0; i < n; i++)
+    wait();
+  printf(1, ok && n == NSPIN + 1 ? "test_affinity ok\n" : "test_affinity failed\n");
+  exit();
+}
@@ -0,0 +1,125 @@
+#include "types.h"
+#include "stat.h"
+#include "param.h"
+#include "user.h"
+#include "pstat.h"
+
+// Runs CPU-bound spinners, one of them niced, next to a
+// process that mostly sleeps, and prints the ticks each spent
+// at every feedback queue level. The spinners should sink to
+// the lowest level between boosts, the niced one should never
+// run above its nice level, and the sleeper should stay near
+// the top.
+
+#define RUNTICKS 500
+#define NSPIN 3
+#define NICE 2
+
+void spin(void)
+{
+  volatile int i;
+
+  for (;;)
+    for (i = 0; i < 1000000; i++)
+      ;
+}
+
+void doze(void)
+{
+  volatile int i;
+
+  for (;;)
+  {
+    for (i = 0; i < 10000; i++)
+      ;
+    sleep(1);
+  }
+}
+
+int find(struct pstat *ps, int pid)
+{
+  int i;
+
+  for (i = 0; i < NPROC; i++)
+    if (ps->inuse[i] && ps->pid[i] == pid)
+      return i;
+  return -1;
+}
+
+void show(struct pstat *ps, int pid, char *what)
+{
+  int i, l;
+
+  if ((i = find(ps, pid)) < 0)
+    return;
+  printf(1, "%s pid %d level %d nice %d ticks", what, pid, ps->level[i], ps->nice[i]);
+  for (l = 0; l < NLEVEL; l++)
+    printf(1, " %d", ps->ticks[i][l]);
+  printf(1, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+  struct pstat ps;
+  int pids[NSPIN + 2], i, j, n, ok;
+
+  n = 0;
+  for (i = 0; i < NSPIN + 2; i++)
+  {
+    // The niced child inherits our nice value, so that it
+    // never runs above it, not even before its first tick.
+    if (i == NSPIN)
+      nice(NICE);
+    pids[n] = fork();
+    if (i == NSPIN && pids[n] != 0)
+      nice(-NICE);
+    if (pids[n] < 0)
+    {
+      printf(1, "test_mlfq: fork failed\n");
+      break;
+    }
+    if (pids[n] == 0)
+    {
+      if (i == NSPIN + 1)
+        doze();
+      spin();
+    }
+    n++;
+  }
+
+  sleep(RUNTICKS);
+  if (getpinfo(&ps) < 0)
+  {
+    printf(1, "test_mlfq: getpinfo failed\n");
+    exit();
+  }
+  for (i = 0; i < n; i++)
+    kill(pids[i]);
+  for (i = 0; i < n; i++)
+    wait();
+
+  ok = n == NSPIN + 2;
+  for (i = 0; i < n; i++)
+  {
+    show(&ps, pids[i], i < NSPIN ? "spin " : i == NSPIN ? "niced" : "doze ");
+    if ((j = find(&ps, pids[i])) < 0)
+      continue;
+    if (i <= NSPIN && ps.ticks[j][NLEVEL - 1] == 0)
+    {
+      printf(1, "test_mlfq: pid %d never reached the lowest level\n", pids[i]);
+      ok = 0;
+    }
+    if (i == NSPIN && ps.ticks[j][0] + ps.ticks[j][1] > 0)
+    {
+      printf(1, "test_mlfq: niced pid %d ran above level %d\n", pids[i], NICE);
+      ok = 0;
+    }
+    if (i == NSPIN + 1 && ps.level[j] == NLEVEL - 1)
+    {
+      printf(1, "test_mlfq: sleeper pid %d sank to the lowest level\n", pids[i]);
+      ok = 0;
+    }
+  }
+  printf(1, ok ? "test_mlfq ok\n" : "test_mlfq failed\n");
+  exit();
+}
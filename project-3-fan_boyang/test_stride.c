@@ -0,0 +1,127 @@
+#include "types.h"
+#include "stat.h"
+#include "param.h"
+#include "user.h"
+#include "pstat.h"
+
+// Switches to stride scheduling and runs three tenants of
+// CPU-bound spinners with 1:2:3 tickets, the last one as three
+// processes sharing its tickets, then prints the share of the
+// CPU time each tenant got against its share of the tickets.
+// Every tenant should get within TOLERANCE percent of its
+// share. Needs fewer CPUs than spinners, so that they contend.
+
+#define RUNTICKS 500
+#define TOLERANCE 10
+#define NTENANT 3
+
+int tickets[NTENANT] = {200, 400, 600};
+int nspin[NTENANT] = {1, 1, 3};
+
+void spin(void)
+{
+  volatile int i;
+
+  for (;;)
+    for (i = 0; i < 1000000; i++)
+      ;
+}
+
+// Run tenant t: set its tickets, shared with its other
+// spinners, and start them.
+void tenant(int t)
+{
+  int i;
+
+  settickets(tickets[t], 1);
+  for (i = 1; i < nspin[t]; i++)
+    if (fork() == 0)
+      break;
+  spin();
+}
+
+// The tenant whose tickets slot i has, or -1.
+int owner(struct pstat *ps, int i)
+{
+  int t;
+
+  if (!ps->inuse[i])
+    return -1;
+  for (t = 0; t < NTENANT; t++)
+    if (ps->tickets[i] == tickets[t])
+      return t;
+  return -1;
+}
+
+// Sum the ticks of each tenant's processes into used.
+void total(struct pstat *ps, int *used)
+{
+  int i, l, t;
+
+  for (t = 0; t < NTENANT; t++)
+    used[t] = 0;
+  for (i = 0; i < NPROC; i++)
+    if ((t = owner(ps, i)) >= 0)
+      for (l = 0; l < NLEVEL; l++)
+        used[t] += ps->ticks[i][l];
+}
+
+int main(int argc, char *argv[])
+{
+  struct pstat ps;
+  int before[NTENANT], after[NTENANT], pids[NTENANT];
+  int old, i, t, n, all, sum, err, ok;
+
+  if ((old = setsched(SCHED_STRIDE)) < 0)
+  {
+    printf(1, "test_stride: setsched failed\n");
+    exit();
+  }
+  n = 0;
+  for (t = 0; t < NTENANT; t++)
+  {
+    if ((pids[n] = fork()) < 0)
+    {
+      printf(1, "test_stride: fork failed\n");
+      break;
+    }
+    if (pids[n] == 0)
+      tenant(t);
+    n++;
+  }
+
+  // Let every spinner start before measuring.
+  sleep(10);
+  getpinfo(&ps);
+  total(&ps, before);
+  sleep(RUNTICKS);
+  getpinfo(&ps);
+  total(&ps, after);
+
+  for (i = 0; i < NPROC; i++)
+    if (owner(&ps, i) >= 0)
+      kill(ps.pid[i]);
+  for (i = 0; i < n; i++)
+    wait();
+  setsched(old);
+
+  all = sum = 0;
+  for (t = 0; t < NTENANT; t++)
+  {
+    after[t] -= before[t];
+    all += after[t];
+    sum += tickets[t];
+  }
+  ok = n == NTENANT && all > 0;
+  for (t = 0; t < NTENANT && ok; t++)
+  {
+    // after[t]/all against tickets[t]/sum, in percent.
+    err = (after[t] * sum - tickets[t] * all) * 100 / (tickets[t] * all);
+    printf(1, "tenant %d: %d tickets in %d processes, %d of %d ticks, off by %d%%\n",
+           t, tickets[t], nspin[t], after[t], all, err);
+    if (err > TOLERANCE || err < -TOLERANCE)
+      ok = 0;
+  }
+  printf(1, ok ? "test_stride ok\n" : "test_stride failed\n");
+  exit();
+}
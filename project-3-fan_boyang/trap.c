@@ -54,6 +54,12 @@ trap(struct trapframe *tf)
       wakeup(&ticks);
       release(&tickslock);
     }
+    schedtick();
+    lapiceoi();
+    break;
+  case T_IRQ0 + IRQ_WAKEUP:
+    // Only there to end a halt in scheduler().
+    schedwakeup();
     lapiceoi();
     break;
   case T_IRQ0 + IRQ_IDE:
@@ -100,9 +106,10 @@ trap(struct trapframe *tf)
   if(myproc() && myproc()->killed && (tf->cs&3) == DPL_USER)
     exit();
 
-  // Force process to give up CPU on clock tick.
+  // Force process to give up CPU on a clock tick that ended
+  // its time slice or found a higher priority process waiting.
   // If interrupts were on while locks held, would need to check nlock.
-  if(myproc() && myproc()->state == RUNNING &&
+  if(myproc() && myproc()->state == RUNNING && myproc()->resched &&
      tf->trapno == T_IRQ0+IRQ_TIMER)
     yield();
 
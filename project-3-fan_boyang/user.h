@@ -1,5 +1,7 @@
 struct stat;
 struct rtcdate;
+struct pstat;
+struct cpustat;
 typedef struct{
   uint flag;
 } lock_t;
@@ -36,6 +38,13 @@ int clone(void(*)(void*), void* arg, void* stack);
 int join(int);
 void cvsleep(void*, lock_t*);
 void cvwake(void*);
+int nice(int);
+int getpinfo(struct pstat*);
+int settickets(int, int);
+int setsched(int);
+int setaffinity(int, uint);
+int getaffinity(int);
+int getcpustat(struct cpustat*);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -0,0 +1,110 @@
+// Page allocator stress benchmark.
+// Runs 1, 2, 4 and 8 worker processes that each loop creating
+// a pipe, passing a byte through it, and forking a child that
+// execs a trivial program, for a fixed number of ticks. Every
+// round allocates and frees a dozen or more physical pages
+// (pipe buffer, kernel stack, page directory, page tables,
+// user memory), so rounds per second tracks kalloc()/kfree()
+// throughput. Compare runs under different CPUS= settings.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define TICKS   300   // how long each worker count runs
+#define MAXWORKERS 8
+
+char *childargv[] = { "allocbench", "-x", 0 };
+
+// One fork/exec/pipe round.
+int
+oneround(void)
+{
+  int fds[2], pid;
+  char c;
+
+  if(pipe(fds) < 0)
+    return -1;
+  c = 'x';
+  if(write(fds[1], &c, 1) != 1 || read(fds[0], &c, 1) != 1)
+    return -1;
+  close(fds[0]);
+  close(fds[1]);
+
+  pid = fork();
+  if(pid < 0)
+    return -1;
+  if(pid == 0){
+    exec("allocbench", childargv);
+    exit();
+  }
+  wait();
+  return 0;
+}
+
+void
+worker(int fd, int deadline)
+{
+  int n;
+
+  n = 0;
+  while(uptime() < deadline){
+    if(oneround() < 0)
+      break;
+    n++;
+  }
+  write(fd, &n, sizeof(n));
+  exit();
+}
+
+void
+run(int nworkers)
+{
+  int fds[2], i, n, total, start, deadline;
+
+  if(pipe(fds) < 0){
+    printf(1, "allocbench: pipe failed\n");
+    exit();
+  }
+  start = uptime();
+  deadline = start + TICKS;
+  for(i = 0; i < nworkers; i++){
+    n = fork();
+    if(n < 0){
+      printf(1, "allocbench: fork failed\n");
+      exit();
+    }
+    if(n == 0){
+      close(fds[0]);
+      worker(fds[1], deadline);
+    }
+  }
+  close(fds[1]);
+
+  total = 0;
+  for(i = 0; i < nworkers; i++){
+    if(read(fds[0], &n, sizeof(n)) != sizeof(n))
+      break;
+    total += n;
+  }
+  close(fds[0]);
+  for(i = 0; i < nworkers; i++)
+    wait();
+
+  printf(1, "workers %d: %d rounds in %d ticks, %d rounds/sec\n",
+         nworkers, total, uptime() - start, total * 100 / TICKS);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n;
+
+  if(argc > 1 && strcmp(argv[1], "-x") == 0)
+    exit();
+
+  printf(1, "allocbench: fork/exec/pipe rounds per second\n");
+  for(n = 1; n <= MAXWORKERS; n *= 2)
+    run(n);
+  exit();
+}